@@ -1,8 +1,10 @@
 #ifndef GENOME_H_INCLUDED
 #define GENOME_H_INCLUDED
 
+#include <array>
 #include <cstdint>
 #include <vector>
+#include <utility>
 #include <cmath>
 #include "sensors-actions.h"
 #include "random.h"
@@ -41,6 +43,42 @@ struct Gene { //__attribute__((packed)) Gene {
 typedef std::vector<Gene> Genome;
 
 
+// Read-only view of a genome stored in a GenomeArena
+struct GenomeView {
+    const Gene *genes;
+    size_t length;
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const Gene &operator[](size_t index) const { return genes[index]; }
+    const Gene *begin() const { return genes; }
+    const Gene *end() const { return genes + length; }
+};
+
+
+// Holds a set of genomes back to back in one contiguous buffer, each one
+// addressed by (offset, length). clear() keeps the allocated capacity, so an
+// arena that is reused every generation stops allocating once it has grown
+// to the largest set of genomes it has held. Views returned by operator[]
+// are invalidated by append() and clear().
+struct GenomeArena {
+    void clear() { genes.clear(); spans.clear(); }
+    void append(const Genome &genome) {
+        spans.push_back( { (uint32_t)genes.size(), (uint32_t)genome.size() } );
+        genes.insert(genes.end(), genome.begin(), genome.end());
+    }
+    size_t size() const { return spans.size(); }
+    bool empty() const { return spans.empty(); }
+    GenomeView operator[](size_t index) const { return { genes.data() + spans[index].offset, spans[index].length }; }
+private:
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+    std::vector<Gene> genes;
+    std::vector<Span> spans;
+};
+
+
 // An individual's "brain" is a neural net specified by a set
 // of Genes where each Gene specifies one connection in the neural net (see
 // Genome comments above). Each neuron has a single output which is
@@ -77,6 +115,25 @@ struct NeuralNet {
     std::vector<Neuron> neurons;
 };
 
+
+// Holds the neural nets of a set of individuals back to back, the way
+// GenomeArena holds genomes, so that a child with the same genome as its
+// parent can take a copy of the parent's wiring instead of rebuilding it.
+struct WiringArena {
+    void clear() { connections.clear(); driven.clear(); neuronSpans.clear(); }
+    void append(const NeuralNet &nnet);
+    void copyTo(size_t index, NeuralNet &nnet) const; // resets the neuron outputs
+    size_t size() const { return neuronSpans.size(); }
+private:
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+    GenomeArena connections;
+    std::vector<uint8_t> driven;
+    std::vector<Span> neuronSpans;
+};
+
 // When a new population is generated and every individual is given a
 // neural net, the neuron outputs must be initialized to something:
 //constexpr float initialNeuronOutput() { return (NEURON_RANGE / 2.0) + NEURON_MIN; }
@@ -85,9 +142,59 @@ constexpr float initialNeuronOutput() { return 0.5; }
 extern Gene makeRandomGene();
 extern Genome makeRandomGenome();
 extern void unitTestConnectNeuralNetWiringFromGenome();
+extern bool unitTestGenomeCompare();
 extern float genomeSimilarity(const Genome &g1, const Genome &g2); // 0.0..1.0
+
+// A genome fingerprint is a 64-bit hash of the genome's contents: identical
+// genomes always have identical fingerprints. Each individual's fingerprint is
+// computed once when it is spawned (see Indiv::initialize()). The overload of
+// genomeSimilarity() taking fingerprints memoizes exact scores in a table that
+// must be cleared with clearGenomeSimilarityCache() whenever the population's
+// genomes change, i.e., once per generation.
+extern uint64_t genomeFingerprint(const Genome &genome);
+extern float genomeSimilarity(uint64_t fingerprint1, const Genome &g1,
+                              uint64_t fingerprint2, const Genome &g2); // 0.0..1.0
+extern void clearGenomeSimilarityCache();
+
+// A MinHash sketch of the set of genes in a genome. Two sketches agree in
+// each slot with probability equal to the Jaccard similarity of the two
+// gene sets. See genome-sketch.cpp.
+constexpr unsigned genomeSketchSize = 32;
+using GenomeSketch = std::array<uint32_t, genomeSketchSize>;
+extern void genomeSketch(const Genome &genome, GenomeSketch &sketch);
+
+// Index of a set of genomes that quickly finds the ones likely to be
+// similar to a given genome. Each genome comes with its sketch. See
+// genome-lsh.cpp.
+struct GenomeLshIndex {
+    static constexpr unsigned bitsPerKey = 12;
+    static constexpr unsigned numBitTables = 20;
+    static constexpr unsigned slotsPerBand = 2;
+    static constexpr unsigned numBands = genomeSketchSize / slotsPerBand;
+    void build(const std::vector<const Genome *> &genomes, const std::vector<const GenomeSketch *> &sketches);
+    void findCandidates(const Genome &genome, const GenomeSketch &sketch,
+                        std::vector<uint32_t> &candidates) const;
+private:
+    unsigned keyOf(const Genome &genome, const GenomeSketch &sketch, unsigned table) const;
+    bool bySketch = false;              // banded sketches rather than sampled bits
+    unsigned numTables = 0;
+    size_t numGenomes = 0;
+    std::vector<uint32_t> bitPositions; // bitsPerKey per table
+    std::vector<uint32_t> bucketStart;  // numBuckets + 1 per table
+    std::vector<uint32_t> entries;      // genome numbers grouped by bucket, per table
+    std::vector<uint32_t> keys;         // scratch for build()
+};
+
 extern float geneticDiversity();  // 0.0..1.0
 
+// Population diversity estimated from the individuals' sketches
+struct DiversityEstimate {
+    float diversity = 0.0;          // 1 - mean Jaccard similarity of all pairs, 0.0..1.0
+    float bound = 0.0;              // half-width of the 95% confidence interval of diversity
+    unsigned distinctGenotypes = 0; // exact, by genome fingerprint
+};
+extern DiversityEstimate estimateDiversity();
+
 } // end namespace BS
 
 #endif // GENOME_H_INCLUDED
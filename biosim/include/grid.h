@@ -36,7 +36,7 @@ public:
     };
 
     void init(uint16_t sizeX, uint16_t sizeY);
-    void zeroFill() { for (Column &column : data) column.zeroFill(); }
+    void zeroFill() { for (Column &column : data) column.zeroFill(); emptyLocations.clear(); full = false; }
     uint16_t sizeX() const { return data.size(); }
     uint16_t sizeY() const { return data[0].size(); }
     bool isInBounds(Coord loc) const { return loc.x >= 0 && loc.x < sizeX() && loc.y >= 0 && loc.y < sizeY(); }
@@ -48,12 +48,15 @@ public:
     uint16_t at(Coord loc) const { return data[loc.x][loc.y]; }
     uint16_t at(uint16_t x, uint16_t y) const { return data[x][y]; }
 
-    void set(Coord loc, uint16_t val) { data[loc.x][loc.y] = val; }
-    void set(uint16_t x, uint16_t y, uint16_t val) { data[x][y] = val; }
-    Coord findEmptyLocation() const;
+    void set(Coord loc, uint16_t val) { data[loc.x][loc.y] = val; full = full && val != EMPTY; }
+    void set(uint16_t x, uint16_t y, uint16_t val) { data[x][y] = val; full = full && val != EMPTY; }
+    bool findEmptyLocation(Coord &loc); // false if there is no empty location
     void createBarrier(unsigned barrierType);
     const std::vector<Coord> &getBarrierLocations() const { return barrierLocations; }
     const std::vector<Coord> &getBarrierCenters() const { return barrierCenters; }
+    // For restoring a checkpoint; the barrier cells must be set separately
+    void setBarriers(const std::vector<Coord> &locations, const std::vector<Coord> &centers)
+        { barrierLocations = locations; barrierCenters = centers; }
     // Direct access:
     Column & operator[](uint16_t columnXNum) { return data[columnXNum]; }
     const Column & operator[](uint16_t columnXNum) const { return data[columnXNum]; }
@@ -61,6 +64,11 @@ private:
     std::vector<Column> data;
     std::vector<Coord> barrierLocations;
     std::vector<Coord> barrierCenters;
+    // Shuffled on demand by findEmptyLocation(); rebuilt after zeroFill()
+    // or when used up
+    std::vector<Coord> emptyLocations;
+    size_t emptyLocationsTaken = 0;
+    bool full = false; // no location was empty at the last rebuild, and none has been emptied since
 };
 
 extern void visitNeighborhood(Coord loc, float radius, std::function<void(Coord)> f);
@@ -6,29 +6,40 @@
 #include <algorithm>
 #include <cstdint>
 #include <array>
+#include <vector>
 #include "basicTypes.h"
 #include "genome-neurons.h"
 
 namespace BS {
 
+struct World;
+class Grid;
+
 // Also see class Peeps.
 
 struct Indiv {
     bool alive;
     uint16_t index;         // index into peeps[] container
+    uint64_t id;            // unique over the whole run, see class Lineage
+    std::array<uint64_t, 2> parentIds; // primary parent first; 0 if none
     Coord loc;              // refers to a location in grid[][]
     Coord birthLoc;
     unsigned age;           // Age isnt age - its a timer?
     Genome genome;
+    uint64_t fingerprint;   // derived from .genome, see genomeFingerprint()
+    GenomeSketch sketch;    // derived from .genome, see genomeSketch()
     NeuralNet nnet;         // derived from .genome
     float responsiveness;   // 0.0..1.0 (0 is like asleep)
     unsigned oscPeriod;     // 2..4*p.stepsPerGeneration (TBD, see executeActions())
     unsigned longProbeDist; // distance for long forward probe for obstructions
     Dir lastMoveDir;        // direction of last movement
     unsigned challengeBits; // modified when the indiv accomplishes some task
-    std::array<float, Action::NUM_ACTIONS> feedForward(unsigned simStep); // reads sensors, returns actions
-    float getSensor(Sensor, unsigned simStep) const;
-    void initialize(uint16_t index, Coord loc, Genome &&genome);
+    std::array<float, Action::NUM_ACTIONS> feedForward(const World &w, unsigned simStep); // reads sensors, returns actions
+    float getSensor(const World &w, Sensor, unsigned simStep) const;
+    void initialize(uint16_t index, Grid &grid, Coord loc, Genome &&genome);
+    void initialize(uint16_t index, Genome &&genome); // everything but the location
+    void initialize(uint16_t index, bool wired = false); // same, using the genome already in .genome
+    void place(Grid &grid, Coord loc); // sets the birth location and claims it in the grid
     void createWiringFromGenome(); // creates .nnet member from .genome member
     void printNeuralNet() const;
     void printIGraphEdgeList() const;
@@ -37,6 +48,25 @@ struct Indiv {
     void getIGraphEdgeList(lineType * lines);
 };
 
+// Exact totals over a generation as it was spawned, kept up to date by
+// initializeGeneration0() and initializeNewGeneration() as each individual
+// is created, so that reports need not walk the population
+struct PopulationStats {
+    unsigned population = 0;
+    std::vector<uint32_t> genomeLengths; // number of individuals by genome length
+    uint64_t numGenes = 0;
+    uint64_t numNeurons = 0;
+    uint64_t numConnections = 0;
+    std::array<uint32_t, Sensor::NUM_SENSES> sensorRefs {};  // connections from each sensor
+    std::array<uint32_t, Action::NUM_ACTIONS> actionRefs {}; // connections to each action
+
+    void clear();
+    void add(const Indiv &indiv); // after its neural net is wired
+    void remove(const Indiv &indiv); // undoes add()
+    void merge(const PopulationStats &other);
+    float averageGenomeLength() const { return population ? (float)numGenes / population : 0.0f; }
+};
+
 } // end namespace BS
 
 #endif // INDIV_H_INCLUDED
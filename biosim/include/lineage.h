@@ -0,0 +1,65 @@
+#ifndef LINEAGE_H_INCLUDED
+#define LINEAGE_H_INCLUDED
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace BS {
+
+class Peeps;
+
+// Records who descended from whom. Every individual ever spawned gets a
+// unique 64-bit id (see Indiv::id); ids are never reused, and 0 means none.
+// The ids of one generation are consecutive: peeps[index].id is the
+// generation's first id plus index - 1.
+//
+// The store follows each individual's primary parent, the one whose genome
+// the child's genome was built on (see generateChildGenome()), so ancestry
+// is a tree. It holds one bucket per generation, oldest first. Within a
+// bucket each individual is a 16-bit id offset from the bucket's first id
+// and the 16-bit position of its parent in the previous bucket. Every so
+// often prune() drops the individuals that have no descendants in the newest
+// generation. Lines of descent coalesce going back in time, so the old
+// buckets shrink to a few entries each and the memory stays bounded.
+//
+// The query functions may be called from any thread.
+class Lineage {
+public:
+    static constexpr uint16_t NO_PARENT = 0xffff;
+
+    // The columns of the store, see checkpoint.cpp
+    struct Columns {
+        uint64_t nextId = 1;
+        unsigned firstGeneration = 0;
+        std::vector<uint64_t> firstIds; // per bucket
+        std::vector<uint32_t> starts;   // per bucket, into offsets and parents
+        std::vector<uint16_t> offsets;  // id - firstIds[bucket], ascending within a bucket
+        std::vector<uint16_t> parents;  // position in the previous bucket, or NO_PARENT
+        size_t sizeAfterPrune = 0;
+    };
+
+    void clear(); // forgets all the generations but not the ids handed out
+    uint64_t newIds(unsigned count); // returns the first of count consecutive ids
+    void addGeneration(unsigned generation, const Peeps &peeps, unsigned population);
+
+    uint64_t mostRecentCommonAncestor(uint64_t id1, uint64_t id2) const; // 0 if none
+    unsigned numDescendants(uint64_t id) const; // in the newest generation
+    size_t size() const; // number of individuals stored
+    unsigned numGenerations() const;
+
+    Columns getColumns() const;
+    void setColumns(Columns &&columns);
+
+private:
+    size_t find(uint64_t id, size_t &bucket) const; // returns an entry number or SIZE_MAX
+    size_t bucketEnd(size_t bucket) const;
+    void prune();
+
+    mutable std::mutex mutex;
+    Columns data;
+};
+
+} // end namespace BS
+
+#endif // LINEAGE_H_INCLUDED
@@ -3,6 +3,7 @@
 
 // Global simulator parameters
 
+#include <atomic>
 #include <string>
 
 // To add a new parameter:
@@ -11,11 +12,12 @@
 //          in params.cpp.
 //    3. Add an else clause to ParamManager::ingestParameter() in params.cpp.
 //    4. Add a line to the user's parameter file (default name biosim4.ini)
+//    5. Add it to transferParams() in checkpoint.cpp
 
 namespace BS {
 
 enum class RunMode { STOP, RUN, PAUSE, ABORT };
-extern RunMode runMode;
+extern std::atomic<RunMode> runMode; // set by the app, polled by the sim and island threads
 
 // A private copy of Params is initialized by ParamManager::init(), then modified by
 // UI events by ParamManager::uiMonitor(). The main simulator thread can get an
@@ -26,7 +28,15 @@ struct Params {
     unsigned stepsPerGeneration; // > 0
     unsigned maxGenerations; // >= 0
     unsigned numThreads; // > 0
+    unsigned numIslands; // > 0, 1 = one world, no islands
+    unsigned islandMigrationInterval; // > 0, in generations
+    unsigned islandMigrants; // >= 0, genomes sent per migration
     unsigned signalLayers; // >= 0
+    bool lazySignalFade;
+    unsigned signalDiffusion; // 0 (off), 5, or 9 (stencil points)
+    unsigned signalDiffusionCenter; // weights in units of 1/256; center + 4*edge + 4*corner <= 256
+    unsigned signalDiffusionEdge;
+    unsigned signalDiffusionCorner;
     unsigned genomeMaxLength; // > 0
     unsigned maxNumberNeurons; // > 0
     double pointMutationRate; // 0.0..1.0
@@ -35,6 +45,7 @@ struct Params {
     bool killEnable;
     bool sexualReproduction;
     bool chooseParentsByFitness;
+    float selectionPressure; // >= 0.0, exponent applied to survival scores
     float populationSensorRadius; // > 0.0
     unsigned signalSensorRadius; // > 0
     float responsiveness; // >= 0.0
@@ -49,7 +60,12 @@ struct Params {
     unsigned agentSize;
     unsigned genomeAnalysisStride; // > 0
     unsigned displaySampleGenomes; // >= 0
-    unsigned genomeComparisonMethod; // 0 = Jaro-Winkler; 1 = Hamming
+    bool epochLogBinary;
+    bool genomeArchive;
+    unsigned genomeArchiveKeyframeStride; // > 0
+    unsigned genomeComparisonMethod; // 0 = longest common subsequence; 1 = Hamming bits; 2 = Hamming bytes
+    bool speciesClustering;
+    float speciesSimilarity; // 0.0..1.0
     bool updateGraphLog;
     unsigned updateGraphLogStride; // > 0
     unsigned challenge;
@@ -77,11 +93,15 @@ public:
     void registerConfigFile(const char *filename);
     void updateFromConfigFile(unsigned generationNumber);
     void checkParameters();
+    void restore(const Params &params); // from a checkpoint
+    bool setParameter(const std::string &name, const std::string &val) { return ingestParameter(name, val); } // as if from the config file
 private:
     Params privParams;
     std::string configFilename;
     int lastModTime; // when config file was last read
-    void ingestParameter(std::string name, std::string val);
+    bool sizesRestored = false; // by restore(), see updateFromConfigFile()
+    bool sizesWarned = false;
+    bool ingestParameter(std::string name, std::string val); // false if invalid
 };
 
 // Returns a copy of params with default values overridden by the values
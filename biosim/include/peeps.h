@@ -11,7 +11,6 @@
 namespace BS {
 
 struct Indiv;
-extern class Grid grid;
 
 // This class keeps track of alive and dead Indiv's and where they
 // are in the Grid.
@@ -33,13 +32,13 @@ public:
     Peeps(); // makes zero individuals
     void init(unsigned population);
     void queueForDeath(const Indiv &);
-    void drainDeathQueue();
+    void drainDeathQueue(Grid &grid, PopulationStats &livingStats);
     void queueForMove(const Indiv &, Coord newLoc);
-    void drainMoveQueue();
+    void drainMoveQueue(Grid &grid);
     unsigned deathQueueSize() const { return deathQueue.size(); }
     // getIndiv() does no error checking -- check first that loc is occupied
-    Indiv & getIndiv(Coord loc) { return individuals[grid.at(loc)]; }
-    const Indiv & getIndiv(Coord loc) const { return individuals[grid.at(loc)]; }
+    Indiv & getIndiv(const Grid &grid, Coord loc) { return individuals[grid.at(loc)]; }
+    const Indiv & getIndiv(const Grid &grid, Coord loc) const { return individuals[grid.at(loc)]; }
     // Direct access:
     Indiv & operator[](uint16_t index) { return individuals[index]; }
     Indiv const & operator[](uint16_t index) const { return individuals[index]; }
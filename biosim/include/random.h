@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <climits>
+#include <vector>
 
 namespace BS {
 
@@ -20,17 +21,33 @@ private:
     uint32_t a, b, c, d;
 public:
     void initialize(); // must be called to seed the RNG
+    void initialize(uint32_t seed, uint32_t stream); // independent stream per key
     uint32_t operator()();
     unsigned operator()(unsigned min, unsigned max);
 };
 
 // The globally-scoped random number generator. Declaring it
-// threadprivate causes each thread to instantiate a private instance.
-extern RandomUintGenerator randomUint;
-//#pragma omp threadprivate(randomUint)
+// thread_local causes each thread to instantiate a private instance.
+extern thread_local RandomUintGenerator randomUint;
 
 constexpr uint32_t RANDOM_UINT_MAX = 0xffffffff;
 
+
+// Walker's alias method, built with Vose's algorithm: after O(n) setup from
+// a list of non-negative weights, sample() returns index i with probability
+// weights[i] / sum(weights) in O(1) using two draws from randomUint. If all
+// the weights are zero, every index is equally likely.
+struct AliasTable {
+    void build(const std::vector<float> &weights);
+    unsigned sample() const;
+    size_t size() const { return probability.size(); }
+private:
+    std::vector<float> probability; // chance of keeping the column's own index
+    std::vector<uint32_t> alias;    // index returned otherwise
+    std::vector<uint32_t> small, large; // scratch for build()
+    std::vector<double> scaled;
+};
+
 } // end namespace BS
 
 #endif // RANDOM_H_INCLUDED
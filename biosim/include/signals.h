@@ -5,45 +5,119 @@
 
 #include <vector>
 #include <cstdint>
+#include <algorithm>
 #include "basicTypes.h"
 
 namespace BS {
 
 // Usage: uint8_t magnitude = signals[layer][x][y];
 // or             magnitude = signals.getMagnitude(layer, Coord);
+//
+// With lazy fading enabled (see init()), fade() only advances a per-layer
+// clock and each cell remembers the clock value when it was last written.
+// The decay is applied when the cell is read by getMagnitude() or written
+// by increment(), so signals[layer][x][y] then returns the undecayed value
+// and must not be used for reading.
+//
+// During a sim step, agents emit with queueForIncrement() into per-thread
+// lists so that all signal reads in the step see a stable snapshot. The
+// lists are merged in bulk by drainIncrementQueue() at the end of the step.
 
 
 constexpr unsigned SIGNAL_MIN = 0;
 constexpr unsigned SIGNAL_MAX = UINT8_MAX;
+constexpr unsigned SIGNAL_FADE = 1; // amount each cell fades per sim step
+constexpr unsigned SIGNAL_TILE_SIZE = 32; // cells per side of an activity tile
 
 struct Signals {
+    // A Column is a view into its layer's storage. Each layer is one
+    // contiguous block in column order (x is the outer index) so that
+    // signals[layer][x][y] still works while fade() and zeroFill() can
+    // sweep a whole layer as a flat array.
     struct Column {
-        Column(uint16_t numRows) : data { std::vector<uint8_t>(numRows, 0) } { }
+        Column(uint8_t *data) : data { data } { }
         uint8_t& operator[](uint16_t rowNum) { return data[rowNum]; }
         uint8_t operator[](uint16_t rowNum) const { return data[rowNum]; }
-        void zeroFill() { std::fill(data.begin(), data.end(), 0); }
     private:
-        std::vector<uint8_t> data;
+        uint8_t *data;
     };
 
+    // Each layer also keeps one flag per SIGNAL_TILE_SIZE square tile. A
+    // tile that is not active holds only zeros, so fade(), zeroFill(), and
+    // diffuse() skip it and getMagnitude() returns 0 without touching the
+    // cells. Writes through add() and increment() mark their tile active;
+    // code that writes through signals[layer][x][y] must call markActive().
     struct Layer {
-        Layer(uint16_t numCols, uint16_t numRows) : data { std::vector<Column>(numCols, Column(numRows)) } { }
-        Column& operator[](uint16_t colNum) { return data[colNum]; }
-        const Column& operator[](uint16_t colNum) const { return data[colNum]; }
-        void zeroFill() { for (Column &col : data) { col.zeroFill(); } }
+        Layer(uint16_t numCols, uint16_t numRows, bool lazyFade)
+            : numCols { numCols }, numRows { numRows },
+              tilesY { (uint16_t)((numRows + SIGNAL_TILE_SIZE - 1) / SIGNAL_TILE_SIZE) },
+              data((size_t)numCols * numRows, 0),
+              tiles((size_t)((numCols + SIGNAL_TILE_SIZE - 1) / SIGNAL_TILE_SIZE) * tilesY, 0),
+              stamps(lazyFade ? (size_t)numCols * numRows : 0, 0), clock { 0 } { }
+        Column operator[](uint16_t colNum) { return Column(&data[(size_t)colNum * numRows]); }
+        const Column operator[](uint16_t colNum) const { return Column(const_cast<uint8_t *>(&data[(size_t)colNum * numRows])); }
+        void zeroFill();
+        uint8_t *cells() { return data.data(); }
+        size_t numCells() const { return data.size(); }
+        bool isLazy() const { return !stamps.empty(); }
+        size_t tileIndex(uint16_t x, uint16_t y) const { return (size_t)(x / SIGNAL_TILE_SIZE) * tilesY + y / SIGNAL_TILE_SIZE; }
+        bool isActive(uint16_t x, uint16_t y) const { return tiles[tileIndex(x, y)] != 0; }
+        void markActive(uint16_t x, uint16_t y) { tiles[tileIndex(x, y)] = 1; }
+        unsigned numActiveTiles() const { return std::count(tiles.begin(), tiles.end(), 1); }
+        // Current (decayed) value of a cell; also valid for non-lazy layers
+        uint8_t magnitude(uint16_t x, uint16_t y) const {
+            if (!isActive(x, y)) {
+                return 0;
+            }
+            size_t cell = (size_t)x * numRows + y;
+            if (stamps.empty()) {
+                return data[cell];
+            }
+            uint32_t decay = std::min<uint32_t>(clock - stamps[cell], SIGNAL_MAX) * SIGNAL_FADE;
+            return data[cell] > decay ? data[cell] - decay : 0;
+        }
+        void add(uint16_t x, uint16_t y, unsigned amount);
+        void fade();
+        void advanceClock() { ++clock; }
     private:
-        std::vector<Column> data;
+        friend struct Signals;
+        template <typename F> void forEachTileColumn(size_t tile, F f);
+
+        uint16_t numCols;
+        uint16_t numRows;
+        uint16_t tilesY;
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> tiles;   // 1 if the tile may hold a non-zero cell
+        std::vector<uint8_t> back;    // diffusion only: ping-pong buffer
+        std::vector<uint8_t> backTiles; // diffusion only: active tiles of back
+        std::vector<uint32_t> stamps; // lazy fade only: clock at last write, per cell
+        uint32_t clock;               // lazy fade only: number of fades so far
     };
 
-    void init(uint16_t layers, uint16_t sizeX, uint16_t sizeY);
+    void init(uint16_t layers, uint16_t sizeX, uint16_t sizeY, bool lazyFade = false, unsigned numThreads = 1);
     Layer& operator[](uint16_t layerNum) { return data[layerNum]; }
     const Layer& operator[](uint16_t layerNum) const { return data[layerNum]; }
-    uint8_t getMagnitude(uint16_t layerNum, Coord loc) const { return (*this)[layerNum][loc.x][loc.y]; }
+    uint8_t getMagnitude(uint16_t layerNum, Coord loc) const { return data[layerNum].magnitude(loc.x, loc.y); }
+    bool anyActive(uint16_t layerNum, Coord loc, float radius) const;
+    unsigned numActiveTiles() const { return activeTiles; } // all layers, as of the last fade()
     void increment(uint16_t layerNum, Coord loc);
-    void zeroFill() { for (Layer &layer : data) { layer.zeroFill(); } }
+    void queueForIncrement(uint16_t layerNum, Coord loc, unsigned threadNum = 0);
+    void drainIncrementQueue();
+    void zeroFill() { for (Layer &layer : data) { layer.zeroFill(); } activeTiles = 0; }
     void fade(unsigned layerNum);
+    void fade(); // all layers
+    void diffuse(); // all layers, see p.signalDiffusion
 private:
+    struct Emission {
+        uint16_t layerNum;
+        Coord loc;
+    };
     std::vector<Layer> data;
+    std::vector<std::vector<Emission>> emitQueues; // one per thread
+    std::vector<uint8_t> emitAmounts;  // scratch for merging dense emissions
+    uint16_t sizeX;
+    uint16_t sizeY;
+    unsigned activeTiles;
 };
 
 } // end namespace BS
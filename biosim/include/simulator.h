@@ -9,6 +9,8 @@
 #include "grid.h"         // the 2D world where the peeps live
 #include "signals.h"      // a 2D array of pheromones that overlay the world grid
 #include "peeps.h"        // the 2D world where the peeps live
+#include "lineage.h"      // who descended from whom
+#include "species.h"      // clusters of similar genomes
 #include "random.h"
 
 namespace BS {
@@ -37,11 +39,32 @@ constexpr unsigned CHALLENGE_LOCATION_SEQUENCE = 16;
 constexpr unsigned CHALLENGE_ALTRUISM = 17;
 constexpr unsigned CHALLENGE_ALTRUISM_SACRIFICE = 18;
 
+// Everything that makes up one simulated world. The simulator runs
+// mainWorld; in island mode each island thread runs one more (see
+// islands.cpp), and a parameter sweep runs one per run (see sweep.cpp).
+// Each thread that touches the simulation points world at the world it runs
+// before anything else. Code on the sim step path reads world once per
+// step and passes the World down rather than reading it again for every
+// agent or sensor.
+struct World {
+    const Params *params = nullptr; // never null once the world runs; mainWorld's are paramManager's
+    Grid grid;        // 2D arena where the individuals live
+    Signals signals;  // pheromone layers
+    Peeps peeps;      // container of all the individuals
+    Lineage lineage;  // ancestry of the individuals
+    Species species;  // species of the individuals, see species.h
+    float wiringReuseRate = 0.0; // fraction of the newest children that copied a parent's wiring
+    float diversity = 0.0; // genetic diversity of the last generation to finish, 0.0..1.0
+    DiversityEstimate diversityEstimate; // the same from genome sketches, with a bound
+    PopulationStats populationStats; // totals over the newest generation, see indiv.h
+    PopulationStats livingStats; // the same over those of it still alive
+    unsigned wiredMaxNumberNeurons = 0; // see spawnNewGeneration.cpp
+    unsigned islandNum = 0;
+    bool primary = true; // only the primary world saves videos, logs, and archives
+};
+
 extern ParamManager paramManager; // manages simulator params from the config file plus more
-extern const Params &p; // read-only simulator config params
-extern Grid grid;  // 2D arena where the individuals live
-extern Signals signals;  // pheromone layers
-extern Peeps peeps;   // container of all the individuals
+extern thread_local World *world; // the calling thread's world, initially mainWorld
 extern unsigned generation;
 extern unsigned survivors;
 
@@ -51,8 +74,37 @@ extern void simulationDone( void );
 extern void simulationMode( int mode );
 
 
+// Checkpoints of the whole simulation state, see checkpoint.cpp. The
+// request functions may be called from any thread; the sim thread carries
+// out the requests between generations in serviceCheckpointRequests().
+extern bool saveCheckpoint(const std::string &filename, unsigned generation, unsigned survivors);
+extern bool loadCheckpoint(const std::string &filename, unsigned &generation, unsigned &survivors);
+extern void requestCheckpointSave(const std::string &filename);
+extern void requestCheckpointLoad(const std::string &filename);
+extern void serviceCheckpointRequests(unsigned &generation, unsigned &survivors);
+
+// Archive of every generation's survivor genomes, see genome-archive.cpp
+extern void archiveGenomes(unsigned generation, const GenomeArena &genomes);
+extern bool readArchivedGenomes(const std::string &dir, unsigned generation, std::vector<Genome> &genomes);
+
+// Island-model evolution, see islands.cpp. exchangeMigrants() is called by
+// spawnNewGeneration() in every world and returns true if it added genomes
+// to the parent arena.
+extern void startIslands();
+extern void stopIslands();
+extern bool exchangeMigrants(unsigned generation, const std::vector<std::pair<uint16_t, float>> &parents,
+                             GenomeArena &parentGenomes, std::vector<uint64_t> &parentIds,
+                             std::vector<float> &parentWeights);
+
+// Parameter sweeps run in the background, see sweep.cpp
+extern bool startSweep(const std::string &configFile, const std::string &sweepFile,
+                       const std::string &resultsFile, unsigned numWorkers);
+extern void stopSweep();
+extern void sweepProgress(unsigned &done, unsigned &total);
+
 // Feeds in-bounds Coords to a function: given a center location and a radius, this
 // function will call f(Coord) once for each location inside the specified area.
+
 extern void visitNeighborhood(Coord loc, float radius, std::function<void(Coord)> f);
 
 } // end namespace BS
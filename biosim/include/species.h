@@ -0,0 +1,49 @@
+#ifndef SPECIES_H_INCLUDED
+#define SPECIES_H_INCLUDED
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace BS {
+
+class Peeps;
+
+// Sorts each new generation into species by leader clustering, seeded with
+// the previous generation's species, so that a species keeps its id for as
+// long as it has members. Ids are never reused, and 0 means none. Each
+// individual is compared through a 64-bit signature made from its genome
+// sketch (see genomeSketch()); each species through the most common
+// signature bits of its members. At most maxSpecies species exist at once.
+// See species.cpp.
+//
+// The query functions may be called from any thread.
+class Species {
+public:
+    static constexpr unsigned maxSpecies = 256;
+
+    void clear(); // forgets the species but not the ids handed out
+    void update(const Peeps &peeps, unsigned population, float minSimilarity);
+
+    uint32_t speciesOf(uint16_t index) const; // species id of peeps[index], or 0
+    std::vector<std::pair<uint32_t, uint32_t>> sizes() const; // (id, members), largest first
+
+private:
+    struct Cluster {
+        uint32_t id;
+        uint32_t size;
+        uint64_t centroid;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Cluster> clusters;  // largest first
+    std::vector<uint32_t> members;  // species id per index
+    uint32_t nextId = 1;
+    std::vector<uint64_t> signatures; // scratch for update()
+    std::vector<uint32_t> slotCounts; // scratch for update()
+};
+
+} // end namespace BS
+
+#endif // SPECIES_H_INCLUDED
@@ -126,6 +126,7 @@ static int SimulationStep(lua_State* L)
     uint8_t color[3];
 
     DM_LUA_STACK_CHECK(L,1);
+    const BS::Params &p = *BS::world->params;
     luaL_checktype(L, 1, LUA_TTABLE);
     luaL_checktype(L, 2, LUA_TTABLE);
 
@@ -140,17 +141,18 @@ static int SimulationStep(lua_State* L)
 
     color[0] = color[1] = color[2] = 0x88;
 
-    for (uint16_t index = 1; index <= BS::p.population; ++index) 
+    const BS::Peeps &peeps = BS::world->peeps;
+    for (uint16_t index = 1; index <= p.population; ++index) 
     {
-        const BS::Indiv &indiv = BS::peeps[index];
+        const BS::Indiv &indiv = peeps[index];
 
         GetGenomeColor(indiv, color);
 
-        lua_pushnumber(L, indiv.loc.x * BS::p.displayScale);
+        lua_pushnumber(L, indiv.loc.x * p.displayScale);
         lua_rawseti(L, 1, idx++); 
-        lua_pushnumber(L, ((BS::p.sizeY - indiv.loc.y) - 1) * BS::p.displayScale); 
+        lua_pushnumber(L, ((p.sizeY - indiv.loc.y) - 1) * p.displayScale); 
         lua_rawseti(L, 1, idx++); 
-        lua_pushnumber(L, BS::p.agentSize);
+        lua_pushnumber(L, p.agentSize);
         lua_rawseti(L, 1, idx++); 
         lua_pushnumber(L, color[0]);  
         lua_rawseti(L, 1, idx++); 
@@ -164,9 +166,9 @@ static int SimulationStep(lua_State* L)
         lua_rawseti(L, 1, idx++); 
         lua_pushnumber(L, (int)indiv.alive);  
         lua_rawseti(L, 1, idx++); 
-        lua_pushnumber(L, indiv.birthLoc.x * BS::p.displayScale);
+        lua_pushnumber(L, indiv.birthLoc.x * p.displayScale);
         lua_rawseti(L, 1, idx++); 
-        lua_pushnumber(L, ((BS::p.sizeY - indiv.birthLoc.y) - 1) * BS::p.displayScale); 
+        lua_pushnumber(L, ((p.sizeY - indiv.birthLoc.y) - 1) * p.displayScale); 
         lua_rawseti(L, 1, idx++); 
     }
 
@@ -175,7 +177,17 @@ static int SimulationStep(lua_State* L)
     lua_rawseti(L, 2, genidx++); 
     lua_pushnumber(L, BS::survivors);
     lua_rawseti(L, 2, genidx++); 
-    lua_pushnumber(L, BS::geneticDiversity());
+    lua_pushnumber(L, BS::world->diversity);
+    lua_rawseti(L, 2, genidx++); 
+    lua_pushnumber(L, BS::world->wiringReuseRate);
+    lua_rawseti(L, 2, genidx++); 
+    lua_pushnumber(L, BS::world->diversityEstimate.diversity);
+    lua_rawseti(L, 2, genidx++); 
+    lua_pushnumber(L, BS::world->diversityEstimate.bound);
+    lua_rawseti(L, 2, genidx++); 
+    lua_pushnumber(L, BS::world->diversityEstimate.distinctGenotypes);
+    lua_rawseti(L, 2, genidx++); 
+    lua_pushnumber(L, BS::world->populationStats.averageGenomeLength());
     lua_rawseti(L, 2, genidx++); 
 
     if(BS::runMode == BS::RunMode::STOP || BS::runMode == BS::RunMode::ABORT)
@@ -185,10 +197,108 @@ static int SimulationStep(lua_State* L)
     return 1;
 }
 
+// Saves or restores the whole simulation to or from the given file. The
+// sim thread does the work at the next generation boundary (see
+// checkpoint.cpp).
+static int SaveCheckpoint(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 0);
+    BS::requestCheckpointSave(luaL_checkstring(L, 1));
+    return 0;
+}
+
+static int LoadCheckpoint(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 0);
+    BS::requestCheckpointLoad(luaL_checkstring(L, 1));
+    return 0;
+}
+
+// Runs a parameter sweep in the background (see sweep.cpp): base config
+// file, sweep file, CSV results file, and optionally the number of worker
+// threads. Returns true if the sweep started. SweepProgress returns the
+// number of runs finished and the total.
+static int RunSweep(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 1);
+    const char *configFile = luaL_checkstring(L, 1);
+    const char *sweepFile = luaL_checkstring(L, 2);
+    const char *resultsFile = luaL_checkstring(L, 3);
+    unsigned numWorkers = luaL_optnumber(L, 4, 0);
+    lua_pushboolean(L, BS::startSweep(configFile, sweepFile, resultsFile, numWorkers));
+    return 1;
+}
+
+static int SweepProgress(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 2);
+    unsigned done;
+    unsigned total;
+    BS::sweepProgress(done, total);
+    lua_pushnumber(L, done);
+    lua_pushnumber(L, total);
+    return 2;
+}
+
+// Returns the number of signal tiles (all layers) that held any pheromone
+// at the end of the last sim step. See signals.h.
+static int SignalActiveTiles(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 1);
+    lua_pushnumber(L, BS::world->signals.numActiveTiles());
+    return 1;
+}
+
+// Ancestry queries by agent uid (see GetAgent and lineage.h). Return the
+// uid of the most recent common ancestor of two agents, or 0 if there is
+// none on record, and the number of agents in the newest generation that
+// descend from an agent.
+static int MostRecentCommonAncestor(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 1);
+    uint64_t id1 = luaL_checknumber(L, 1);
+    uint64_t id2 = luaL_checknumber(L, 2);
+    lua_pushnumber(L, BS::world->lineage.mostRecentCommonAncestor(id1, id2));
+    return 1;
+}
+
+static int LineageSize(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 1);
+    lua_pushnumber(L, BS::world->lineage.numDescendants(luaL_checknumber(L, 1)));
+    return 1;
+}
+
+// Fills the first table with the species id of each agent, indexed like
+// GetAgent, and the second with the number of agents of each species,
+// indexed by species id. Returns the number of species. Species are
+// clustered at the start of each generation (see species.h); ids are 0 if
+// speciesClustering is off.
+static int GetSpecies(lua_State* L)
+{
+    DM_LUA_STACK_CHECK(L, 1);
+    const BS::Params &p = *BS::world->params;
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    for (uint16_t index = 1; index <= p.population; ++index) {
+        lua_pushnumber(L, BS::world->species.speciesOf(index));
+        lua_rawseti(L, 1, index);
+    }
+    const std::vector<std::pair<uint32_t, uint32_t>> sizes = BS::world->species.sizes();
+    for (const std::pair<uint32_t, uint32_t> &size : sizes) {
+        lua_pushnumber(L, size.second);
+        lua_rawseti(L, 2, size.first);
+    }
+    lua_pushnumber(L, sizes.size());
+    return 1;
+}
+
 //   Get a list of points and lines with weights. This is passed to drawpixels for circles and lines
 static int GetAgent(lua_State* L)
 {
     DM_LUA_STACK_CHECK(L,0);
+    const BS::Params &p = *BS::world->params;
     int coordx = luaL_checknumber(L, 1);
     int coordy = luaL_checknumber(L, 2);
     luaL_checktype(L, 3, LUA_TTABLE);   // Agent data
@@ -200,17 +310,17 @@ static int GetAgent(lua_State* L)
 
     // Convert coords back to local corrds for indiv
     BS::Coord     loc;
-    loc.x = coordx / BS::p.displayScale;
-    loc.y = -((coordy / BS::p.displayScale) + 1 - BS::p.sizeY); 
+    loc.x = coordx / p.displayScale;
+    loc.y = -((coordy / p.displayScale) + 1 - p.sizeY); 
 
-    loc.x = min(loc.x, BS::grid.sizeX() - 1);
-    loc.y = min(loc.y, BS::grid.sizeY() - 1);
+    loc.x = min(loc.x, BS::world->grid.sizeX() - 1);
+    loc.y = min(loc.y, BS::world->grid.sizeY() - 1);
     loc.x = max(loc.x, 0);
     loc.y = max(loc.y, 0);
 
-    if(BS::grid.isOccupiedAt(loc)) {
+    if(BS::world->grid.isOccupiedAt(loc)) {
         
-        BS::Indiv &indiv = BS::peeps.getIndiv( loc );
+        BS::Indiv &indiv = BS::world->peeps.getIndiv( BS::world->grid, loc );
         BS::lineType   lines;
 
         uint8_t color[3];
@@ -232,6 +342,15 @@ static int GetAgent(lua_State* L)
         lua_pushstring(L, "responsiveness");
         lua_pushnumber(L, indiv.responsiveness );
         lua_rawset(L, 5);
+        lua_pushstring(L, "uid");
+        lua_pushnumber(L, indiv.id );
+        lua_rawset(L, 5);
+        lua_pushstring(L, "parent1");
+        lua_pushnumber(L, indiv.parentIds[0] );
+        lua_rawset(L, 5);
+        lua_pushstring(L, "parent2");
+        lua_pushnumber(L, indiv.parentIds[1] );
+        lua_rawset(L, 5);
 
         // Get all the neural paths
         indiv.getIGraphEdgeList(&lines);
@@ -283,6 +402,14 @@ static const luaL_reg Module_methods[] =
     {"SimulationStart", SimulationStart},
     {"SimulationMode", SimulationMode },
     {"GetAgent", GetAgent },
+    {"SignalActiveTiles", SignalActiveTiles },
+    {"SaveCheckpoint", SaveCheckpoint },
+    {"LoadCheckpoint", LoadCheckpoint },
+    {"MostRecentCommonAncestor", MostRecentCommonAncestor },
+    {"LineageSize", LineageSize },
+    {"GetSpecies", GetSpecies },
+    {"RunSweep", RunSweep },
+    {"SweepProgress", SweepProgress },
     {0, 0}
 };
 
@@ -1,8 +1,8 @@
 // analysis.cpp -- various reports
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <cassert>
 #include <cstring>
 #include <string>
@@ -282,39 +282,72 @@ void  Indiv::getIGraphEdgeList(lineType * lines)
 }
 
 
-float averageGenomeLength()
+void PopulationStats::clear()
 {
-    unsigned count = 100;
-    unsigned numberSamples = 0;
-    unsigned long sum = 0;
+    *this = PopulationStats();
+}
+
 
-    while (count-- > 0) {
-        sum += peeps[randomUint(1, p.population)].genome.size();
-        ++numberSamples;
+void PopulationStats::add(const Indiv &indiv)
+{
+    ++population;
+    if (indiv.genome.size() >= genomeLengths.size()) {
+        genomeLengths.resize(indiv.genome.size() + 1, 0);
+    }
+    ++genomeLengths[indiv.genome.size()];
+    numGenes += indiv.genome.size();
+    numNeurons += indiv.nnet.neurons.size();
+    numConnections += indiv.nnet.connections.size();
+    for (const Gene &gene : indiv.nnet.connections) {
+        if (gene.sourceType == SENSOR) {
+            assert(gene.sourceNum < Sensor::NUM_SENSES);
+            ++sensorRefs[gene.sourceNum];
+        }
+        if (gene.sinkType == ACTION) {
+            assert(gene.sinkNum < Action::NUM_ACTIONS);
+            ++actionRefs[gene.sinkNum];
+        }
     }
-    return sum / numberSamples;
 }
 
 
-// The epoch log contains one line per generation in a format that can be
-// fed to graphlog.gp to produce a chart of the simulation progress.
-// ToDo: remove hardcoded filename.
-void appendEpochLog(unsigned generation, unsigned numberSurvivors, unsigned murderCount)
+// Undoes add(indiv), as when indiv dies
+void PopulationStats::remove(const Indiv &indiv)
 {
-    std::ofstream foutput;
-
-    if (generation == 0) {
-        foutput.open(p.logDir + "/epoch-log.txt");
-        foutput.close();
+    assert(population > 0 && indiv.genome.size() < genomeLengths.size());
+    --population;
+    --genomeLengths[indiv.genome.size()];
+    numGenes -= indiv.genome.size();
+    numNeurons -= indiv.nnet.neurons.size();
+    numConnections -= indiv.nnet.connections.size();
+    for (const Gene &gene : indiv.nnet.connections) {
+        if (gene.sourceType == SENSOR) {
+            --sensorRefs[gene.sourceNum];
+        }
+        if (gene.sinkType == ACTION) {
+            --actionRefs[gene.sinkNum];
+        }
     }
+}
 
-    foutput.open(p.logDir + "/epoch-log.txt", std::ios::app);
 
-    if (foutput.is_open()) {
-        foutput << generation << " " << numberSurvivors << " " << geneticDiversity()
-                << " " << averageGenomeLength() << " " << murderCount << std::endl;
-    } else {
-        assert(false);
+void PopulationStats::merge(const PopulationStats &other)
+{
+    population += other.population;
+    if (other.genomeLengths.size() > genomeLengths.size()) {
+        genomeLengths.resize(other.genomeLengths.size(), 0);
+    }
+    for (size_t length = 0; length < other.genomeLengths.size(); ++length) {
+        genomeLengths[length] += other.genomeLengths[length];
+    }
+    numGenes += other.numGenes;
+    numNeurons += other.numNeurons;
+    numConnections += other.numConnections;
+    for (unsigned n = 0; n < sensorRefs.size(); ++n) {
+        sensorRefs[n] += other.sensorRefs[n];
+    }
+    for (unsigned n = 0; n < actionRefs.size(); ++n) {
+        actionRefs[n] += other.actionRefs[n];
     }
 }
 
@@ -322,6 +355,7 @@ void appendEpochLog(unsigned generation, unsigned numberSurvivors, unsigned murd
 // Print stats about pheromone usage.
 void displaySignalUse()
 {
+    const Params &p = *world->params;
     if (Sensor::SIGNAL0 > Sensor::NUM_SENSES && Sensor::SIGNAL0_FWD > Sensor::NUM_SENSES && Sensor::SIGNAL0_LR > Sensor::NUM_SENSES) {
         return;
     }
@@ -331,7 +365,7 @@ void displaySignalUse()
 
     for (int16_t x = 0; x < p.sizeX; ++x) {
         for (int16_t y = 0; y < p.sizeY; ++y) {
-            unsigned magnitude = signals.getMagnitude(0, { x, y });
+            unsigned magnitude = world->signals.getMagnitude(0, { x, y });
             if (magnitude != 0) {
                 ++count;
                 sum += magnitude;
@@ -344,27 +378,13 @@ void displaySignalUse()
 
 // Print how many connections occur from each kind of sensor neuron and to
 // each kind of action neuron over the entire population. This helps us to
-// see which sensors and actions are most useful for survival.
+// see which sensors and actions are most useful for survival. Only the
+// living are counted, from the totals kept in livingStats.
 void displaySensorActionReferenceCounts()
 {
-    std::vector<unsigned> sensorCounts(Sensor::NUM_SENSES, 0);
-    std::vector<unsigned> actionCounts(Action::NUM_ACTIONS, 0);
-
-    for (unsigned index = 1; index <= p.population; ++index) {
-        if (peeps[index].alive) {
-            const Indiv &indiv = peeps[index];
-            for (const Gene &gene : indiv.nnet.connections) {
-                if (gene.sourceType == SENSOR) {
-                    assert(gene.sourceNum < Sensor::NUM_SENSES);
-                    ++sensorCounts[(Sensor)gene.sourceNum];
-                }
-                if (gene.sinkType == ACTION) {
-                    assert(gene.sinkNum < Action::NUM_ACTIONS);
-                    ++actionCounts[(Action)gene.sinkNum];
-                }
-            }
-        }
-    }
+    const PopulationStats &livingStats = world->livingStats;
+    const std::array<uint32_t, Sensor::NUM_SENSES> &sensorCounts = livingStats.sensorRefs;
+    const std::array<uint32_t, Action::NUM_ACTIONS> &actionCounts = livingStats.actionRefs;
 
     std::cout << "Sensors in use:" << std::endl;
     for (unsigned i = 0; i < sensorCounts.size(); ++i) {
@@ -378,11 +398,17 @@ void displaySensorActionReferenceCounts()
             std::cout << "  " << actionCounts[i] << " - " << actionName((Action)i) << std::endl;
         }
     }
+    const unsigned population = std::max(1U, livingStats.population);
+    std::cout << "Average genome length " << livingStats.averageGenomeLength()
+              << ", neurons " << (float)livingStats.numNeurons / population
+              << ", connections " << (float)livingStats.numConnections / population << std::endl;
 }
 
 
 void displaySampleGenomes(unsigned count)
 {
+    const Params &p = *world->params;
+    Peeps &peeps = world->peeps;
     unsigned index = 1; // indexes start at 1
     for (index = 1; count > 0 && index <= p.population; ++index) {
         if (peeps[index].alive) {
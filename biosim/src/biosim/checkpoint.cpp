@@ -0,0 +1,631 @@
+// checkpoint.cpp -- save and restore the complete simulation state
+
+// A checkpoint is a versioned binary snapshot taken between generations,
+// holding the parameters, the generation counters, every Indiv, the grid
+// (including barriers), the signal layers, and the sim thread's RNG state.
+// Values derived from those (neural nets, genome fingerprints and sketches,
+// caches) are rebuilt on restore, so a deterministic run continues
+// bit-identically. Species are clustered afresh, so their ids change.
+//
+// Saving serializes the state into memory in one sequential pass on the
+// sim thread, then a background thread writes the buffer to a temporary
+// file and renames it over the destination, so a crash during the write
+// never leaves a truncated checkpoint behind. Restoring maps the file into
+// memory (where mmap is available) and copies the sections out in bulk.
+//
+// Layout: "BSCK", uint32 version, uint64 payload size, then the payload in
+// the order of transferState(). Fields are stored in native byte order.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "simulator.h"
+
+namespace BS {
+
+constexpr char checkpointMagic[4] = { 'B', 'S', 'C', 'K' };
+constexpr uint32_t checkpointVersion = 8;
+constexpr size_t checkpointHeaderSize = sizeof(checkpointMagic) + sizeof(uint32_t) + sizeof(uint64_t);
+
+
+// Appends values to a byte buffer
+struct CheckpointWriter {
+    std::vector<uint8_t> bytes;
+
+    void raw(const void *data, size_t size) {
+        const uint8_t *begin = (const uint8_t *)data;
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+    template <typename T> void io(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "use an overload");
+        raw(&value, sizeof(T));
+    }
+    void io(const std::string &s) {
+        io((uint64_t)s.size());
+        raw(s.data(), s.size());
+    }
+    template <typename T> void io(const std::vector<T> &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "vector of non-trivial type");
+        io((uint64_t)v.size());
+        raw(v.data(), v.size() * sizeof(T));
+    }
+};
+
+
+// Reads values back in the same order. After any read runs past the end
+// of the data, ok is false and the remaining reads do nothing.
+struct CheckpointReader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool ok = true;
+
+    bool raw(void *data, size_t size) {
+        if (!ok || (size_t)(end - pos) < size) {
+            ok = false;
+            return false;
+        }
+        if (size > 0) { // data may be null, as for an empty vector
+            std::memcpy(data, pos, size);
+            pos += size;
+        }
+        return true;
+    }
+    template <typename T> void io(T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "use an overload");
+        raw(&value, sizeof(T));
+    }
+    void io(std::string &s) {
+        uint64_t size = 0;
+        io(size);
+        if (ok && (uint64_t)(end - pos) >= size) {
+            s.assign((const char *)pos, size);
+            pos += size;
+        } else {
+            ok = false;
+        }
+    }
+    template <typename T> void io(std::vector<T> &v) {
+        uint64_t size = 0;
+        io(size);
+        if (ok && (uint64_t)(end - pos) / sizeof(T) >= size) {
+            v.resize(size);
+            raw(v.data(), size * sizeof(T));
+        } else {
+            ok = false;
+        }
+    }
+};
+
+
+// Lists every member of Params once for both directions. A new member of
+// Params must be added here too.
+template <typename Archive, typename P>
+static void transferParams(Archive &ar, P &params)
+{
+    ar.io(params.population);
+    ar.io(params.stepsPerGeneration);
+    ar.io(params.maxGenerations);
+    ar.io(params.numThreads);
+    ar.io(params.numIslands);
+    ar.io(params.islandMigrationInterval);
+    ar.io(params.islandMigrants);
+    ar.io(params.signalLayers);
+    ar.io(params.lazySignalFade);
+    ar.io(params.signalDiffusion);
+    ar.io(params.signalDiffusionCenter);
+    ar.io(params.signalDiffusionEdge);
+    ar.io(params.signalDiffusionCorner);
+    ar.io(params.genomeMaxLength);
+    ar.io(params.maxNumberNeurons);
+    ar.io(params.pointMutationRate);
+    ar.io(params.geneInsertionDeletionRate);
+    ar.io(params.deletionRatio);
+    ar.io(params.killEnable);
+    ar.io(params.sexualReproduction);
+    ar.io(params.chooseParentsByFitness);
+    ar.io(params.selectionPressure);
+    ar.io(params.populationSensorRadius);
+    ar.io(params.signalSensorRadius);
+    ar.io(params.responsiveness);
+    ar.io(params.responsivenessCurveKFactor);
+    ar.io(params.longProbeDistance);
+    ar.io(params.shortProbeBarrierDistance);
+    ar.io(params.valenceSaturationMag);
+    ar.io(params.saveVideo);
+    ar.io(params.videoStride);
+    ar.io(params.videoSaveFirstFrames);
+    ar.io(params.displayScale);
+    ar.io(params.agentSize);
+    ar.io(params.genomeAnalysisStride);
+    ar.io(params.displaySampleGenomes);
+    ar.io(params.epochLogBinary);
+    ar.io(params.genomeArchive);
+    ar.io(params.genomeArchiveKeyframeStride);
+    ar.io(params.genomeComparisonMethod);
+    ar.io(params.speciesClustering);
+    ar.io(params.speciesSimilarity);
+    ar.io(params.updateGraphLog);
+    ar.io(params.updateGraphLogStride);
+    ar.io(params.challenge);
+    ar.io(params.barrierType);
+    ar.io(params.deterministic);
+    ar.io(params.RNGSeed);
+    ar.io(params.sizeX);
+    ar.io(params.sizeY);
+    ar.io(params.genomeInitialLengthMin);
+    ar.io(params.genomeInitialLengthMax);
+    ar.io(params.logDir);
+    ar.io(params.imageDir);
+    ar.io(params.graphLogUpdateCommand);
+    ar.io(params.parameterChangeGenerationNumber);
+}
+
+
+// The persistent members of Indiv. fingerprint and nnet are derived from
+// the genome and are rebuilt on restore.
+template <typename Archive, typename I>
+static void transferIndiv(Archive &ar, I &indiv)
+{
+    ar.io(indiv.alive);
+    ar.io(indiv.index);
+    ar.io(indiv.id);
+    ar.io(indiv.parentIds);
+    ar.io(indiv.loc);
+    ar.io(indiv.birthLoc);
+    ar.io(indiv.age);
+    ar.io(indiv.genome);
+    ar.io(indiv.responsiveness);
+    ar.io(indiv.oscPeriod);
+    ar.io(indiv.longProbeDist);
+    ar.io(indiv.lastMoveDir);
+    ar.io(indiv.challengeBits);
+}
+
+
+template <typename Archive, typename C>
+static void transferLineage(Archive &ar, C &columns)
+{
+    ar.io(columns.nextId);
+    ar.io(columns.firstGeneration);
+    ar.io(columns.firstIds);
+    ar.io(columns.starts);
+    ar.io(columns.offsets);
+    ar.io(columns.parents);
+    ar.io(columns.sizeAfterPrune);
+}
+
+
+// Serializes the state after the parameters. Must be called in
+// single-thread mode between generations.
+static void writeState(CheckpointWriter &ar, unsigned generation, unsigned survivors)
+{
+    const Params &p = *world->params;
+    const Grid &grid = world->grid;
+    const Signals &signals = world->signals;
+    Peeps &peeps = world->peeps;
+
+    ar.io(generation);
+    ar.io(survivors);
+    ar.io(world->diversity);
+    ar.io(world->diversityEstimate);
+    ar.io(randomUint);
+
+    for (uint16_t index = 1; index <= p.population; ++index) {
+        transferIndiv(ar, peeps[index]);
+    }
+    const Lineage::Columns lineageColumns = world->lineage.getColumns();
+    transferLineage(ar, lineageColumns);
+
+    std::vector<uint16_t> cells;
+    cells.reserve((size_t)p.sizeX * p.sizeY);
+    for (uint16_t x = 0; x < p.sizeX; ++x) {
+        for (uint16_t y = 0; y < p.sizeY; ++y) {
+            cells.push_back(grid.at(x, y));
+        }
+    }
+    ar.io(cells);
+    ar.io(grid.getBarrierLocations());
+    ar.io(grid.getBarrierCenters());
+
+    // Decayed magnitudes, so lazy layers restore without their clocks
+    std::vector<uint8_t> magnitudes;
+    magnitudes.reserve((size_t)p.sizeX * p.sizeY);
+    for (uint16_t layerNum = 0; layerNum < p.signalLayers; ++layerNum) {
+        magnitudes.clear();
+        for (int16_t x = 0; x < p.sizeX; ++x) {
+            for (int16_t y = 0; y < p.sizeY; ++y) {
+                magnitudes.push_back(signals.getMagnitude(layerNum, { x, y }));
+            }
+        }
+        ar.io(magnitudes);
+    }
+}
+
+
+// Everything in a checkpoint after the parameters, held until the whole
+// file has been read and checked
+struct SavedState {
+    unsigned generation = 0;
+    unsigned survivors = 0;
+    float diversity = 0.0;
+    DiversityEstimate diversityEstimate;
+    RandomUintGenerator rng;
+    std::vector<Indiv> indivs; // peeps[1..population]
+    Lineage::Columns lineageColumns;
+    std::vector<uint16_t> cells;
+    std::vector<Coord> barrierLocations;
+    std::vector<Coord> barrierCenters;
+    std::vector<std::vector<uint8_t>> magnitudes; // per signal layer
+};
+
+
+// Checks that the columns form buckets as lineage.h describes them: the
+// starts ascend from 0, the offsets ascend within each bucket, and every
+// parent is NO_PARENT in the first bucket and a position in the previous
+// bucket after that
+static bool validLineage(const Lineage::Columns &columns)
+{
+    const size_t numBuckets = columns.starts.size();
+    if (numBuckets != columns.firstIds.size() || columns.parents.size() != columns.offsets.size()) {
+        return false;
+    }
+    if (numBuckets == 0) {
+        return columns.offsets.empty();
+    }
+    if (columns.starts.front() != 0 || !std::is_sorted(columns.starts.begin(), columns.starts.end())
+            || columns.starts.back() > columns.offsets.size()) {
+        return false;
+    }
+
+    for (size_t bucket = 0; bucket < numBuckets; ++bucket) {
+        const size_t begin = columns.starts[bucket];
+        const size_t end = bucket + 1 < numBuckets ? columns.starts[bucket + 1] : columns.offsets.size();
+        const size_t previousSize = bucket > 0 ? begin - columns.starts[bucket - 1] : 0;
+        for (size_t entry = begin; entry < end; ++entry) {
+            if (entry > begin && columns.offsets[entry] <= columns.offsets[entry - 1]) {
+                return false;
+            }
+            const uint16_t parent = columns.parents[entry];
+            if (bucket == 0 ? parent != Lineage::NO_PARENT
+                            : parent != Lineage::NO_PARENT && parent >= previousSize) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Reads the state saved with params and checks that it fits them. Touches
+// nothing outside state.
+static bool readState(CheckpointReader &ar, const Params &params, SavedState &state)
+{
+    const size_t numCells = (size_t)params.sizeX * params.sizeY;
+    auto inBounds = [&](Coord loc) {
+        return loc.x >= 0 && loc.x < params.sizeX && loc.y >= 0 && loc.y < params.sizeY;
+    };
+
+    ar.io(state.generation);
+    ar.io(state.survivors);
+    ar.io(state.diversity);
+    ar.io(state.diversityEstimate);
+    ar.io(state.rng);
+
+    state.indivs.resize(params.population);
+    for (uint16_t index = 1; index <= params.population && ar.ok; ++index) {
+        Indiv &indiv = state.indivs[index - 1];
+        transferIndiv(ar, indiv);
+        if (indiv.index != index || !inBounds(indiv.loc) || !inBounds(indiv.birthLoc)) {
+            return false;
+        }
+    }
+    transferLineage(ar, state.lineageColumns);
+    if (!ar.ok || !validLineage(state.lineageColumns)) {
+        return false;
+    }
+
+    ar.io(state.cells);
+    ar.io(state.barrierLocations);
+    ar.io(state.barrierCenters);
+    if (!ar.ok || state.cells.size() != numCells) {
+        return false;
+    }
+    for (uint16_t cell : state.cells) {
+        if (cell != EMPTY && cell != BARRIER && cell > params.population) {
+            return false;
+        }
+    }
+    for (const std::vector<Coord> *barriers : { &state.barrierLocations, &state.barrierCenters }) {
+        if (!std::all_of(barriers->begin(), barriers->end(), inBounds)) {
+            return false;
+        }
+    }
+
+    state.magnitudes.resize(params.signalLayers);
+    for (std::vector<uint8_t> &magnitudes : state.magnitudes) {
+        ar.io(magnitudes);
+        if (!ar.ok || magnitudes.size() != numCells) {
+            return false;
+        }
+    }
+    return ar.pos == ar.end;
+}
+
+
+// Replaces the calling thread's world with state. The containers must
+// already have the sizes state was read for.
+static void applyState(SavedState &state, unsigned &generation, unsigned &survivors)
+{
+    const Params &p = *world->params;
+    Grid &grid = world->grid;
+    Signals &signals = world->signals;
+    Peeps &peeps = world->peeps;
+
+    generation = state.generation;
+    survivors = state.survivors;
+    for (uint16_t index = 1; index <= p.population; ++index) {
+        peeps[index] = std::move(state.indivs[index - 1]);
+    }
+
+    grid.zeroFill();
+    size_t cell = 0;
+    for (uint16_t x = 0; x < p.sizeX; ++x) {
+        for (uint16_t y = 0; y < p.sizeY; ++y) {
+            grid.set(x, y, state.cells[cell++]);
+        }
+    }
+    grid.setBarriers(state.barrierLocations, state.barrierCenters);
+
+    signals.zeroFill();
+    for (uint16_t layerNum = 0; layerNum < p.signalLayers; ++layerNum) {
+        const std::vector<uint8_t> &magnitudes = state.magnitudes[layerNum];
+        cell = 0;
+        for (uint16_t x = 0; x < p.sizeX; ++x) {
+            for (uint16_t y = 0; y < p.sizeY; ++y) {
+                if (magnitudes[cell] != 0) {
+                    signals[layerNum].add(x, y, magnitudes[cell]);
+                }
+                ++cell;
+            }
+        }
+    }
+
+    // Rebuild the derived state
+    world->populationStats.clear();
+    world->livingStats.clear();
+    for (uint16_t index = 1; index <= p.population; ++index) {
+        Indiv &indiv = peeps[index];
+        indiv.fingerprint = genomeFingerprint(indiv.genome);
+        genomeSketch(indiv.genome, indiv.sketch);
+        indiv.createWiringFromGenome();
+        world->populationStats.add(indiv);
+        if (indiv.alive) {
+            world->livingStats.add(indiv);
+        }
+    }
+    clearGenomeSimilarityCache();
+    world->lineage.setColumns(std::move(state.lineageColumns));
+    world->species.clear();
+    if (p.speciesClustering) {
+        world->species.update(peeps, p.population, p.speciesSimilarity);
+    }
+
+    world->diversity = state.diversity;
+    world->diversityEstimate = state.diversityEstimate;
+    randomUint = state.rng;
+}
+
+
+// Background writes: at most one at a time
+static std::atomic<bool> checkpointWriteInProgress { false };
+
+static void writeCheckpointFile(std::string filename, std::vector<uint8_t> bytes)
+{
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = std::fopen(tmpFilename.c_str(), "wb");
+    bool ok = f != nullptr;
+    if (ok) {
+        ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+        ok = (std::fclose(f) == 0) && ok;
+    }
+    if (ok) {
+        std::remove(filename.c_str()); // rename() does not replace on all platforms
+        ok = std::rename(tmpFilename.c_str(), filename.c_str()) == 0;
+    }
+    if (!ok) {
+        std::cerr << "Could not write checkpoint " << filename << std::endl;
+        std::remove(tmpFilename.c_str());
+    }
+    checkpointWriteInProgress = false;
+}
+
+
+// Must be called in single-thread mode between generations. Returns after
+// the state has been copied; the file is written in the background.
+bool saveCheckpoint(const std::string &filename, unsigned generation, unsigned survivors)
+{
+    const Params &p = *world->params;
+    while (checkpointWriteInProgress) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    CheckpointWriter ar;
+    ar.bytes.reserve(checkpointHeaderSize + 64 * 1024);
+    ar.raw(checkpointMagic, sizeof(checkpointMagic));
+    ar.io(checkpointVersion);
+    ar.io((uint64_t)0); // payload size, filled in below
+    transferParams(ar, p);
+    writeState(ar, generation, survivors);
+
+    uint64_t payloadSize = ar.bytes.size() - checkpointHeaderSize;
+    std::memcpy(&ar.bytes[sizeof(checkpointMagic) + sizeof(uint32_t)], &payloadSize, sizeof(payloadSize));
+
+    checkpointWriteInProgress = true;
+    std::thread(writeCheckpointFile, filename, std::move(ar.bytes)).detach();
+    return true;
+}
+
+
+// Read-only view of a whole file: memory-mapped where possible, otherwise
+// read into a buffer.
+struct FileView {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    std::vector<uint8_t> buffer;
+    void *mapping = nullptr;
+
+    bool open(const std::string &filename) {
+#if !defined(_WIN32)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (m != MAP_FAILED) {
+                    mapping = m;
+                    data = (const uint8_t *)m;
+                    size = st.st_size;
+                }
+            }
+            ::close(fd);
+            if (mapping != nullptr) {
+                return true;
+            }
+        }
+#endif
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+    }
+    ~FileView() {
+#if !defined(_WIN32)
+        if (mapping != nullptr) {
+            munmap(mapping, size);
+        }
+#endif
+    }
+};
+
+
+// Must be called in single-thread mode between generations. On success,
+// replaces the parameters and the whole simulation state, reallocating
+// the grid, signals, and peeps if the saved sizes differ, and restarts the
+// islands. The whole file is read and checked before anything is replaced,
+// so on failure the current state is kept.
+bool loadCheckpoint(const std::string &filename, unsigned &generation, unsigned &survivors)
+{
+    const Params &p = *world->params;
+    FileView file;
+    if (!file.open(filename)) {
+        std::cerr << "Could not open checkpoint " << filename << std::endl;
+        return false;
+    }
+
+    CheckpointReader ar { file.data, file.data + file.size };
+    char magic[sizeof(checkpointMagic)];
+    uint32_t version = 0;
+    uint64_t payloadSize = 0;
+    ar.raw(magic, sizeof(magic));
+    ar.io(version);
+    ar.io(payloadSize);
+    if (!ar.ok || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0) {
+        std::cerr << filename << " is not a checkpoint" << std::endl;
+        return false;
+    }
+    if (version != checkpointVersion) {
+        std::cerr << "Checkpoint " << filename << " has version " << version
+                  << ", expected " << checkpointVersion << std::endl;
+        return false;
+    }
+    if (payloadSize != file.size - checkpointHeaderSize) {
+        std::cerr << "Checkpoint " << filename << " is truncated" << std::endl;
+        return false;
+    }
+
+    Params params = p;
+    transferParams(ar, params);
+    SavedState state;
+    if (!ar.ok || !readState(ar, params, state)) {
+        std::cerr << "Checkpoint " << filename << " is damaged" << std::endl;
+        return false;
+    }
+
+    // The islands read the parameters about to be replaced, and are sized
+    // from them, so they start over once the restore is done
+    stopIslands();
+    const bool resize = params.sizeX != p.sizeX || params.sizeY != p.sizeY
+                     || params.signalLayers != p.signalLayers || params.population != p.population
+                     || params.lazySignalFade != p.lazySignalFade || params.numThreads != p.numThreads;
+    paramManager.restore(params);
+    if (resize) {
+        world->grid.init(p.sizeX, p.sizeY);
+        world->signals.init(p.signalLayers, p.sizeX, p.sizeY, p.lazySignalFade, p.numThreads);
+        world->peeps.init(p.population);
+    }
+    applyState(state, generation, survivors);
+    startIslands();
+    return true;
+}
+
+
+// Requests from other threads (e.g., the Lua bindings), carried out by the
+// sim thread at the next generation boundary
+static std::mutex checkpointRequestMutex;
+static std::string checkpointSaveRequest;
+static std::string checkpointLoadRequest;
+
+void requestCheckpointSave(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(checkpointRequestMutex);
+    checkpointSaveRequest = filename;
+}
+
+
+void requestCheckpointLoad(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(checkpointRequestMutex);
+    checkpointLoadRequest = filename;
+}
+
+
+// Called by the sim thread between generations. A pending load is done
+// before a pending save.
+void serviceCheckpointRequests(unsigned &generation, unsigned &survivors)
+{
+    std::string saveFilename;
+    std::string loadFilename;
+    {
+        std::lock_guard<std::mutex> lock(checkpointRequestMutex);
+        std::swap(saveFilename, checkpointSaveRequest);
+        std::swap(loadFilename, checkpointLoadRequest);
+    }
+
+    if (!loadFilename.empty() && loadCheckpoint(loadFilename, generation, survivors)) {
+        std::cout << "Restored generation " << generation << " from " << loadFilename << std::endl;
+    }
+    if (!saveFilename.empty() && saveCheckpoint(saveFilename, generation, survivors)) {
+        std::cout << "Saving generation " << generation << " to " << saveFilename << std::endl;
+    }
+}
+
+} // end namespace BS
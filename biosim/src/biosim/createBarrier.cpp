@@ -17,13 +17,14 @@ namespace BS {
 
 void Grid::createBarrier(unsigned barrierType)
 {
+    const Params &p = *world->params;
     barrierLocations.clear();
     barrierCenters.clear();  // used only for some barrier types
 
     auto drawBox = [&](int16_t minX, int16_t minY, int16_t maxX, int16_t maxY) {
         for (int16_t x = minX; x <= maxX; ++x) {
             for (int16_t y = minY; y <= maxY; ++y) {
-                grid.set(x, y, BARRIER);
+                set(x, y, BARRIER);
                 barrierLocations.push_back( {x, y} );
             }
         }
@@ -43,7 +44,7 @@ void Grid::createBarrier(unsigned barrierType)
 
             for (int16_t x = minX; x <= maxX; ++x) {
                 for (int16_t y = minY; y <= maxY; ++y) {
-                    grid.set(x, y, BARRIER);
+                    set(x, y, BARRIER);
                     barrierLocations.push_back( {x, y} );
                 }
             }
@@ -60,7 +61,7 @@ void Grid::createBarrier(unsigned barrierType)
 
             for (int16_t x = minX; x <= maxX; ++x) {
                 for (int16_t y = minY; y <= maxY; ++y) {
-                    grid.set(x, y, BARRIER);
+                    set(x, y, BARRIER);
                     barrierLocations.push_back( {x, y} );
                 }
             }
@@ -107,7 +108,7 @@ void Grid::createBarrier(unsigned barrierType)
 
             for (int16_t x = minX; x <= maxX; ++x) {
                 for (int16_t y = minY; y <= maxY; ++y) {
-                    grid.set(x, y, BARRIER);
+                    set(x, y, BARRIER);
                     barrierLocations.push_back( {x, y} );
                 }
             }
@@ -144,7 +145,7 @@ void Grid::createBarrier(unsigned barrierType)
             //barrierCenters.push_back(center2);
 
             auto f = [&](Coord loc) {
-                grid.set(loc, BARRIER);
+                set(loc, BARRIER);
                 barrierLocations.push_back(loc);
             };
 
@@ -161,7 +162,7 @@ void Grid::createBarrier(unsigned barrierType)
             float radius = 5.0;
 
             auto f = [&](Coord loc) {
-                grid.set(loc, BARRIER);
+                set(loc, BARRIER);
                 barrierLocations.push_back(loc);
             };
 
@@ -15,6 +15,11 @@ namespace BS {
 
 void endOfGeneration(unsigned generation)
 {
+    const Params &p = *world->params;
+    if (!world->primary) {
+        return; // islands have no video or graph
+    }
+
     {
         if (p.saveVideo &&
                 ((generation % p.videoStride) == 0
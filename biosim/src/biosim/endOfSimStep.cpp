@@ -16,13 +16,19 @@ mode to take care of several things:
    a scenario is in progress.
 3. We then drain the deferred death queue.
 4. We then drain the deferred movement queue.
-5. We fade the signal layer(s) (pheromones).
+5. We apply the queued signal emissions, then diffuse (if enabled) and
+   fade the signal layer(s) (pheromones).
 6. We save the resulting world condition as a single image frame (if
-   p.saveVideo is true).
+   p.saveVideo is true and this is the primary world).
 */
 
 void endOfSimStep(unsigned simStep, unsigned generation)
 {
+    const Params &p = *world->params;
+    Grid &grid = world->grid;
+    Signals &signals = world->signals;
+    Peeps &peeps = world->peeps;
+
     if (p.challenge == CHALLENGE_RADIOACTIVE_WALLS) {
         // During the first half of the generation, the west wall is radioactive,
         // where X == 0. In the last half of the generation, the east wall is
@@ -75,12 +81,14 @@ void endOfSimStep(unsigned simStep, unsigned generation)
         }
     }
 
-    peeps.drainDeathQueue();
-    peeps.drainMoveQueue();
-    signals.fade(0); // takes layerNum  todo!!!
+    peeps.drainDeathQueue(grid, world->livingStats);
+    peeps.drainMoveQueue(grid);
+    signals.drainIncrementQueue();
+    signals.diffuse();
+    signals.fade(); // all layers
 
     // saveVideoFrameSync() is the synchronous version of saveVideFrame()
-    if (p.saveVideo &&
+    if (world->primary && p.saveVideo &&
                 ((generation % p.videoStride) == 0
                  || generation <= p.videoSaveFirstFrames
                  || (generation >= p.parameterChangeGenerationNumber
@@ -0,0 +1,251 @@
+// epoch-log.cpp -- per-generation statistics log
+
+// The epoch log has one record per generation: the generation, survivors,
+// diversity, average genome length, murders, then the sketch diversity
+// estimate, its 95% bound, and the number of distinct genotypes (see
+// genome-sketch.cpp). It is written either as text, one line per record in a
+// format that can be fed to graphlog.gp to produce a chart of the simulation
+// progress, or, if p.epochLogBinary is true, as a binary file of fixed-width
+// records that tools can mmap (see below).
+//
+// appendEpochLog() only copies the record into an in-memory ring. A thread
+// of its own writes out whatever the ring holds in one batch, as soon as
+// epochLogBatch records are waiting or once a second, and keeps the file open
+// between batches. If the disk falls so far behind that the ring fills up,
+// the newest records are dropped and counted rather than making the sim
+// thread wait. A generation 0 record, i.e., the start of a run or a restart
+// after an extinction, starts a new file.
+//
+// Binary layout, in native byte order: "BSEL", uint32 version, uint32 number
+// of columns, uint32 record size, then for each column a 24-byte name padded
+// with zeros, a uint32 type (0 = uint32, 1 = float32), and a uint32 offset
+// within the record. The records follow, each record size bytes; the number
+// of complete records is (file size - header size) / record size.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+namespace {
+
+struct EpochRecord {
+    uint32_t generation;
+    uint32_t survivors;
+    float diversity;
+    float averageGenomeLength;
+    uint32_t murders;
+    float diversityEstimate;
+    float diversityBound;
+    uint32_t distinctGenotypes;
+};
+
+struct EpochColumn {
+    char name[24];
+    uint32_t type;
+    uint32_t offset;
+};
+
+#define EPOCH_COLUMN(member, type) { #member, type, (uint32_t)offsetof(EpochRecord, member) }
+const EpochColumn epochColumns[] = {
+    EPOCH_COLUMN(generation, 0),
+    EPOCH_COLUMN(survivors, 0),
+    EPOCH_COLUMN(diversity, 1),
+    EPOCH_COLUMN(averageGenomeLength, 1),
+    EPOCH_COLUMN(murders, 0),
+    EPOCH_COLUMN(diversityEstimate, 1),
+    EPOCH_COLUMN(diversityBound, 1),
+    EPOCH_COLUMN(distinctGenotypes, 0),
+};
+#undef EPOCH_COLUMN
+
+const char epochLogMagic[4] = { 'B', 'S', 'E', 'L' };
+constexpr uint32_t epochLogVersion = 1;
+constexpr unsigned epochLogCapacity = 4096; // records in the ring
+constexpr unsigned epochLogBatch = 64;      // records that wake the writer early
+
+struct EpochEntry {
+    EpochRecord record;
+    bool restart;
+    bool binary;
+    std::string dir;
+};
+
+}
+
+
+// Owns the ring and the writer thread. The destructor, run at program exit,
+// writes out the records still in the ring.
+class EpochLogWriter {
+public:
+    ~EpochLogWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // Never waits for the disk
+    void append(const EpochEntry &entry) {
+        bool wakeNow;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ring.empty()) {
+                ring.resize(epochLogCapacity);
+            }
+            if (count == epochLogCapacity) {
+                ++numDropped;
+                return;
+            }
+            ring[(first + count) % epochLogCapacity] = entry;
+            ++count;
+            wakeNow = (count >= epochLogBatch || entry.restart);
+            if (!thread.joinable()) {
+                thread = std::thread(&EpochLogWriter::run, this);
+            }
+        }
+        if (wakeNow) {
+            wake.notify_one();
+        }
+    }
+
+private:
+    void run() {
+        std::vector<EpochEntry> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait_for(lock, std::chrono::seconds(1),
+                          [this] { return stopping || count >= epochLogBatch; });
+            batch.clear();
+            while (count > 0) {
+                batch.push_back(std::move(ring[first]));
+                first = (first + 1) % epochLogCapacity;
+                --count;
+            }
+            const unsigned dropped = numDropped;
+            numDropped = 0;
+            const bool stop = stopping;
+            lock.unlock();
+
+            if (dropped > 0) {
+                std::cerr << "Epoch log fell behind, " << dropped << " records dropped" << std::endl;
+            }
+            for (const EpochEntry &entry : batch) {
+                write(entry);
+            }
+            file.flush();
+
+            lock.lock();
+            if (stop && count == 0) {
+                return;
+            }
+        }
+    }
+
+    // Opens the file for the entry if it is not already open
+    bool open(const EpochEntry &entry) {
+        if (file.is_open() && !entry.restart && entry.dir == openDir && entry.binary == openBinary) {
+            return true;
+        }
+        file.close();
+        file.clear();
+        openDir = entry.dir;
+        openBinary = entry.binary;
+        const std::string filename = entry.dir + (entry.binary ? "/epoch-log.bin" : "/epoch-log.txt");
+        const auto mode = entry.binary ? std::ios::binary : std::ios::openmode();
+        file.open(filename, mode | (entry.restart ? std::ios::trunc : std::ios::app | std::ios::ate));
+        if (!file.is_open()) {
+            if (!failed) {
+                std::cerr << "Could not open the epoch log " << filename << std::endl;
+            }
+            failed = true;
+            return false;
+        }
+        failed = false;
+
+        if (entry.binary && file.tellp() == 0) {
+            const uint32_t numColumns = sizeof(epochColumns) / sizeof(epochColumns[0]);
+            const uint32_t recordSize = sizeof(EpochRecord);
+            file.write(epochLogMagic, sizeof(epochLogMagic));
+            file.write((const char *)&epochLogVersion, sizeof(epochLogVersion));
+            file.write((const char *)&numColumns, sizeof(numColumns));
+            file.write((const char *)&recordSize, sizeof(recordSize));
+            file.write((const char *)epochColumns, sizeof(epochColumns));
+        }
+        return true;
+    }
+
+    void write(const EpochEntry &entry) {
+        if (!open(entry)) {
+            return;
+        }
+        const EpochRecord &record = entry.record;
+        if (entry.binary) {
+            file.write((const char *)&record, sizeof(record));
+        } else {
+            file << record.generation << " " << record.survivors << " " << record.diversity
+                 << " " << record.averageGenomeLength << " " << record.murders
+                 << " " << record.diversityEstimate << " " << record.diversityBound
+                 << " " << record.distinctGenotypes << '\n';
+        }
+        if (!file) {
+            if (!failed) {
+                std::cerr << "Could not write the epoch log in " << entry.dir << std::endl;
+            }
+            failed = true;
+            file.close(); // reopened for the next record
+        }
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<EpochEntry> ring;
+    unsigned first = 0;
+    unsigned count = 0;
+    unsigned numDropped = 0;
+    bool stopping = false;
+
+    // Writer thread only
+    std::ofstream file;
+    std::string openDir;
+    bool openBinary = false;
+    bool failed = false;
+};
+
+static EpochLogWriter epochLogWriter;
+
+
+// Called once per generation by the primary world
+void appendEpochLog(unsigned generation, unsigned numberSurvivors, unsigned murderCount)
+{
+    const Params &p = *world->params;
+    EpochEntry entry;
+    entry.record.generation = generation;
+    entry.record.survivors = numberSurvivors;
+    entry.record.diversity = world->diversity;
+    entry.record.averageGenomeLength = world->populationStats.averageGenomeLength();
+    entry.record.murders = murderCount;
+    entry.record.diversityEstimate = world->diversityEstimate.diversity;
+    entry.record.diversityBound = world->diversityEstimate.bound;
+    entry.record.distinctGenotypes = world->diversityEstimate.distinctGenotypes;
+    entry.restart = (generation == 0);
+    entry.binary = p.epochLogBinary;
+    entry.dir = p.logDir;
+    epochLogWriter.append(entry);
+}
+
+} // end namespace BS
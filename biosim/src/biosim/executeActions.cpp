@@ -24,9 +24,9 @@ bool prob2bool(float factor)
 // exponential curve. The steepness of the curve is determined by the K factor
 // which is a small positive integer. This tends to reduce the activity level
 // a bit (makes the peeps less reactive and jittery).
-float responseCurve(float r)
+float responseCurve(float r, unsigned kFactor)
 {
-    const float k = p.responsivenessCurveKFactor;
+    const float k = kFactor;
     return std::pow((r - 2.0), -2.0 * k) - std::pow(2.0, -2.0 * k) * (1.0 - r);
 }
 
@@ -54,18 +54,21 @@ strong level, we do this:
          our own individual during this function)
     SET_OSCILLATOR_PERIOD action - immediately change our individual's indiv.oscPeriod
          to the action level exponentially scaled to 2..2048 (TBD)
-    EMIT_SIGNALn action(s) - immediately increment the signal level at our agent's
-         location using signals.increment() (using a thread-safe call)
+    EMIT_SIGNALn action(s) - queue an increment of the signal level at our agent's
+         location with signals.queueForIncrement(); the queue will be applied at the
+         end of the sim step so that signal reads during the step see a stable snapshot
     KILL_FORWARD action - queue the other agent for deferred death with
          peeps.queueForDeath()
 
-The deferred movement and death queues will be emptied by the caller at the end of the
+The deferred movement, death, and signal queues will be emptied by the caller at the end of the
 simulator step by endOfSimStep() in a single thread after all individuals have been
-evaluated multithreadedly.
+evaluated multithreadedly. w is the world the individual lives in.
 **********************************************************************************/
 
-void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &actionLevels)
+void executeActions(World &w, Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &actionLevels)
 {
+    const Params &p = *w.params;
+
     // Only a subset of all possible actions might be enabled (i.e., compiled in).
     // This returns true if the specified action is enabled. See sensors-actions.h
     // for how to enable sensors and actions during compilation.
@@ -82,7 +85,7 @@ void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &action
 
     // For the rest of the action outputs, we'll apply an adjusted responsiveness
     // factor (see responseCurve() for more info). Range 0.0..1.0.
-    float responsivenessAdjusted = responseCurve(indiv.responsiveness);
+    float responsivenessAdjusted = responseCurve(indiv.responsiveness, p.responsivenessCurveKFactor);
 
     // Oscillator period action - convert action level nonlinearly to
     // 2..4*p.stepsPerGeneration. If this action neuron is enabled but not driven,
@@ -109,15 +112,15 @@ void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &action
     // Emit signal0 - if this action value is below a threshold, nothing emitted.
     // Otherwise convert the action value to a probability of emitting one unit of
     // signal (pheromone).
-    // Pheromones may be emitted immediately (see signals.cpp). If this action neuron
-    // is enabled but not driven, nothing will be emitted.
+    // Pheromones are queued and applied at the end of the sim step (see signals.cpp).
+    // If this action neuron is enabled but not driven, nothing will be emitted.
     if (isEnabled(Action::EMIT_SIGNAL0)) {
         constexpr float emitThreshold = 0.5;  // 0.0..1.0; 0.5 is midlevel
         float level = actionLevels[Action::EMIT_SIGNAL0];
         level = (std::tanh(level) + 1.0) / 2.0; // convert to 0.0..1.0
         level *= responsivenessAdjusted;
         if (level > emitThreshold && prob2bool(level)) {
-            signals.increment(0, indiv.loc);
+            w.signals.queueForIncrement(0, indiv.loc);
         }
     }
 
@@ -131,10 +134,10 @@ void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &action
         level *= responsivenessAdjusted;
         if (level > killThreshold && prob2bool((level - ACTION_MIN) / ACTION_RANGE)) {
             Coord otherLoc = indiv.loc + indiv.lastMoveDir;
-            if (grid.isInBounds(otherLoc) && grid.isOccupiedAt(otherLoc)) {
-                Indiv &indiv2 = peeps.getIndiv(otherLoc);
+            if (w.grid.isInBounds(otherLoc) && w.grid.isOccupiedAt(otherLoc)) {
+                Indiv &indiv2 = w.peeps.getIndiv(w.grid, otherLoc);
                 assert((indiv.loc - indiv2.loc).length() == 1);
-                peeps.queueForDeath(indiv2);
+                w.peeps.queueForDeath(indiv2);
             }
         }
     }
@@ -227,8 +230,8 @@ void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &action
 
     // Move there if it's a valid location
     Coord newLoc = indiv.loc + movementOffset;
-    if (grid.isInBounds(newLoc) && grid.isEmptyAt(newLoc)) {
-        peeps.queueForMove(indiv, newLoc);
+    if (w.grid.isInBounds(newLoc) && w.grid.isEmptyAt(newLoc)) {
+        w.peeps.queueForMove(indiv, newLoc);
     }
 }
 
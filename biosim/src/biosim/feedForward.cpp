@@ -39,7 +39,7 @@ We have three types of neurons:
          actionLevels[] which is returned to the caller by value (thanks RVO).
 ********************************************************************************/
 
-std::array<float, Action::NUM_ACTIONS> Indiv::feedForward(unsigned simStep)
+std::array<float, Action::NUM_ACTIONS> Indiv::feedForward(const World &w, unsigned simStep)
 {
     // This container is used to return values for all the action outputs. This array
     // contains one value per action neuron, which is the sum of all its weighted
@@ -76,7 +76,7 @@ std::array<float, Action::NUM_ACTIONS> Indiv::feedForward(unsigned simStep)
         // The values are summed for now, later passed through a transfer function
         float inputVal;
         if (conn.sourceType == SENSOR) {
-            inputVal = getSensor((Sensor)conn.sourceNum, simStep);
+            inputVal = getSensor(w, (Sensor)conn.sourceNum, simStep);
         } else {
             inputVal = nnet.neurons[conn.sourceNum].output;
         }
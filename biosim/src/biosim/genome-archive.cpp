@@ -0,0 +1,587 @@
+// genome-archive.cpp -- append-only archive of every generation's survivor genomes
+
+// If p.genomeArchive is true, spawnNewGeneration() passes each generation's
+// parent genomes to archiveGenomes(). Two files are appended in p.logDir:
+//
+//   genome-archive.bin  "BSGA", uint32 version, then one block per generation
+//   genome-archive.idx  one fixed-size IndexRecord per block
+//
+// The blocks are for consecutive generations, so the record of a generation
+// is found by its distance from the first one.
+//
+// A block is a keyframe every p.genomeArchiveKeyframeStride generations and
+// otherwise a delta block encoded against the previous generation's block.
+// Each genome in a block is stored as one of:
+//   0, length, genes...                  literal
+//   1, ref                               identical to genome ref
+//   2, ref, length, diffs                genome ref with some genes replaced
+//   3, ref, ref2, start, count, length, diffs
+//                                        genome ref with genes start..start+count-1
+//                                        taken from ref2, then some replaced
+// where diffs is a count followed by (position delta, gene) pairs. A ref
+// below the size of the previous block refers to a genome of that block,
+// otherwise to an earlier genome of the same block; a keyframe refers only
+// to itself. All counts, positions, and refs are LEB128 varints and genes
+// are 4 raw bytes. Most survivors are unmutated copies or crossovers of the
+// previous generation's survivors (see generateChildGenome()), so they are
+// stored in a few bytes each.
+//
+// Encoding happens on the sim thread; the finished block is handed to a
+// writer thread, so the simulator never waits on the disk. The archive is
+// restarted whenever generation 0 is archived, the same as the epoch log,
+// and whenever a generation does not follow the last one archived, as after
+// a checkpoint is restored.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+constexpr char archiveMagic[4] = { 'B', 'S', 'G', 'A' };
+constexpr uint32_t archiveVersion = 2;
+
+struct IndexRecord {
+    uint32_t generation;
+    uint32_t keyframeGeneration;
+    uint64_t offset;         // of this generation's block in genome-archive.bin
+    uint64_t size;
+    uint64_t keyframeOffset; // of the block to start decoding from
+    uint64_t numGenomes;     // in this generation's block
+};
+
+enum GenomeEncoding : uint8_t { LITERAL = 0, DUPLICATE = 1, DELTA = 2, SPLICE = 3 };
+
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+
+static void putGene(std::vector<uint8_t> &out, const Gene &gene)
+{
+    uint8_t bytes[sizeof(Gene)];
+    std::memcpy(bytes, &gene, sizeof(Gene));
+    out.insert(out.end(), bytes, bytes + sizeof(Gene));
+}
+
+
+// The genome a DELTA or SPLICE encoding starts from: ref cut or padded with
+// zero genes to length, with genes start..start+count-1 taken from ref2 if
+// there is one
+static void spliceBase(const Genome &ref, const Genome *ref2, size_t start, size_t count,
+                       size_t length, Genome &base)
+{
+    base.assign(ref.begin(), ref.begin() + std::min(length, ref.size()));
+    base.resize(length, Gene {});
+    if (ref2 != nullptr) {
+        const size_t end = std::min( { start + count, length, ref2->size() } );
+        for (size_t i = start; i < end; ++i) {
+            base[i] = (*ref2)[i];
+        }
+    }
+}
+
+
+static bool sameGene(const Gene &g1, const Gene &g2)
+{
+    return std::memcmp(&g1, &g2, sizeof(Gene)) == 0;
+}
+
+
+static uint64_t geneAt(size_t position, const Gene &gene)
+{
+    uint32_t word;
+    std::memcpy(&word, &gene, sizeof(word));
+    return ((uint64_t)position << 32) | word;
+}
+
+
+static unsigned countDiffs(const Genome &genome, const Genome &base)
+{
+    unsigned diffs = 0;
+    for (size_t i = 0; i < genome.size(); ++i) {
+        diffs += !sameGene(genome[i], base[i]);
+    }
+    return diffs;
+}
+
+
+static void putDiffs(std::vector<uint8_t> &out, const Genome &genome, const Genome &base, unsigned numDiffs)
+{
+    putVarint(out, numDiffs);
+    size_t lastPosition = 0;
+    for (size_t i = 0; i < genome.size(); ++i) {
+        if (!sameGene(genome[i], base[i])) {
+            putVarint(out, i - lastPosition);
+            putGene(out, genome[i]);
+            lastPosition = i;
+        }
+    }
+}
+
+
+// Writes blocks to the files on its own thread. The destructor, run at
+// program exit, finishes the queued writes.
+class ArchiveWriter {
+public:
+    ~ArchiveWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // restart truncates the files before the block is written
+    void enqueue(std::vector<uint8_t> &&bytes, IndexRecord record, bool restart, const std::string &dir) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back( { std::move(bytes), record, restart, dir } );
+            if (!thread.joinable()) {
+                thread = std::thread(&ArchiveWriter::run, this);
+            }
+        }
+        wake.notify_one();
+    }
+
+private:
+    struct Job {
+        std::vector<uint8_t> bytes;
+        IndexRecord record;
+        bool restart;
+        std::string dir;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return; // stopping
+            }
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            write(job);
+            lock.lock();
+        }
+    }
+
+    void write(const Job &job) {
+        const std::string dataFilename = job.dir + "/genome-archive.bin";
+        const std::string indexFilename = job.dir + "/genome-archive.idx";
+        if (job.restart) {
+            std::ofstream data(dataFilename, std::ios::binary | std::ios::trunc);
+            data.write(archiveMagic, sizeof(archiveMagic));
+            data.write((const char *)&archiveVersion, sizeof(archiveVersion));
+            std::ofstream index(indexFilename, std::ios::binary | std::ios::trunc);
+            dataSize = sizeof(archiveMagic) + sizeof(archiveVersion);
+            keyframeOffset = dataSize;
+        }
+
+        IndexRecord record = job.record;
+        record.offset = dataSize;
+        if (record.keyframeGeneration == record.generation) {
+            keyframeOffset = dataSize;
+        }
+        record.keyframeOffset = keyframeOffset;
+
+        // The block is complete on disk before its index record appears, so
+        // readArchivedGenomes() can run while the archive grows
+        std::ofstream data(dataFilename, std::ios::binary | std::ios::app);
+        data.write((const char *)job.bytes.data(), job.bytes.size());
+        data.close();
+        std::ofstream index(indexFilename, std::ios::binary | std::ios::app);
+        if (data) {
+            index.write((const char *)&record, sizeof(record));
+        }
+        if (!data || !index) {
+            std::cerr << "Could not write the genome archive in " << job.dir << std::endl;
+        }
+        dataSize += job.bytes.size();
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    uint64_t dataSize = 0;       // writer thread only
+    uint64_t keyframeOffset = 0; // writer thread only
+};
+
+static ArchiveWriter archiveWriter;
+
+static void findGenomesWithGenes(const std::unordered_map<uint64_t, std::vector<uint32_t>> &genomesWithGene,
+                                 const Genome &genome, size_t position1, size_t position2,
+                                 std::vector<uint32_t> &candidates)
+{
+    candidates.clear();
+    for (size_t position : { position1, position2 }) {
+        auto found = genomesWithGene.find(geneAt(position, genome[position]));
+        if (found != genomesWithGene.end()) {
+            candidates.insert(candidates.end(), found->second.begin(), found->second.end());
+        }
+    }
+}
+
+
+// Encoder state, sim thread only: the previously archived generation
+static std::vector<Genome> previousGenomes;
+static std::vector<Genome> currentGenomes;
+static std::unordered_map<uint64_t, uint32_t> refByFingerprint;
+static unsigned keyframeGeneration = 0;
+static unsigned lastGeneration = 0;
+static bool archiveStarted = false;
+
+
+// Must be called in single-thread mode between generations, with the
+// genomes of the generation's survivors
+void archiveGenomes(unsigned generation, const GenomeArena &genomes)
+{
+    const Params &p = *world->params;
+    if (!p.genomeArchive) {
+        return;
+    }
+
+    const bool restart = !archiveStarted || generation != lastGeneration + 1;
+    const bool keyframe = restart || generation - keyframeGeneration >= p.genomeArchiveKeyframeStride;
+    if (keyframe) {
+        keyframeGeneration = generation;
+        previousGenomes.clear();
+        refByFingerprint.clear();
+    }
+
+    std::vector<uint8_t> out;
+    putVarint(out, generation);
+    out.push_back(keyframe);
+    putVarint(out, genomes.size());
+
+    // The distinct previous genomes that have a given gene at a given
+    // position, for finding the parents of crossover children
+    constexpr unsigned maxCandidates = 64;
+    std::vector<uint32_t> distinct;
+    for (const auto &entry : refByFingerprint) {
+        distinct.push_back(entry.second);
+    }
+    std::sort(distinct.begin(), distinct.end());
+    std::unordered_map<uint64_t, std::vector<uint32_t>> genomesWithGene;
+    for (uint32_t n : distinct) {
+        for (size_t i = 0; i < previousGenomes[n].size(); ++i) {
+            std::vector<uint32_t> &numbers = genomesWithGene[geneAt(i, previousGenomes[n][i])];
+            if (numbers.size() < maxCandidates) {
+                numbers.push_back(n);
+            }
+        }
+    }
+
+    const uint32_t numPrevious = previousGenomes.size();
+    std::vector<uint32_t> candidates;
+    std::vector<uint64_t> fingerprints(genomes.size());
+    Genome base;
+    currentGenomes.resize(genomes.size());
+
+    for (size_t n = 0; n < genomes.size(); ++n) {
+        Genome &genome = currentGenomes[n];
+        genome.assign(genomes[n].begin(), genomes[n].end());
+        fingerprints[n] = genomeFingerprint(genome);
+
+        auto duplicate = refByFingerprint.emplace(fingerprints[n], numPrevious + n);
+        if (!duplicate.second) {
+            const uint32_t ref = duplicate.first->second;
+            const Genome &original = ref < numPrevious ? previousGenomes[ref] : currentGenomes[ref - numPrevious];
+            if (original.size() == genome.size()
+                    && std::memcmp(original.data(), genome.data(), genome.size() * sizeof(Gene)) == 0) {
+                out.push_back(DUPLICATE);
+                putVarint(out, ref);
+                continue;
+            }
+        }
+        if (previousGenomes.empty()) {
+            out.push_back(LITERAL);
+            putVarint(out, genome.size());
+            for (const Gene &gene : genome) {
+                putGene(out, gene);
+            }
+            continue;
+        }
+
+        // Choose the most similar of the genomes that share the first or the
+        // last gene, as the first parent of a crossover child usually does
+        findGenomesWithGenes(genomesWithGene, genome, 0, genome.size() - 1, candidates);
+        candidates.push_back(n % numPrevious);
+        uint32_t ref = 0;
+        unsigned refDiffs = genome.size() + 1;
+        for (uint32_t candidate : candidates) {
+            spliceBase(previousGenomes[candidate], nullptr, 0, 0, genome.size(), base);
+            const unsigned diffs = countDiffs(genome, base);
+            if (diffs < refDiffs) {
+                refDiffs = diffs;
+                ref = candidate;
+            }
+        }
+
+        // A crossover child differs from one parent only in the slice it took
+        // from the other, so look for a genome that can fill the span of the
+        // differences
+        uint32_t ref2 = ref;
+        size_t start = 0;
+        size_t count = 0;
+        unsigned spliceDiffs = refDiffs;
+        if (refDiffs > 1) {
+            spliceBase(previousGenomes[ref], nullptr, 0, 0, genome.size(), base);
+            size_t first = 0;
+            while (sameGene(genome[first], base[first])) {
+                ++first;
+            }
+            size_t last = genome.size() - 1;
+            while (sameGene(genome[last], base[last])) {
+                --last;
+            }
+            findGenomesWithGenes(genomesWithGene, genome, first, last, candidates);
+            for (uint32_t candidate : candidates) {
+                spliceBase(previousGenomes[ref], &previousGenomes[candidate], first, last - first + 1,
+                           genome.size(), base);
+                const unsigned diffs = countDiffs(genome, base);
+                if (diffs + 1 < spliceDiffs) {
+                    spliceDiffs = diffs;
+                    ref2 = candidate;
+                    start = first;
+                    count = last - first + 1;
+                }
+            }
+        }
+
+        // A differing gene costs about 5 bytes in a delta, any gene 4 in a literal
+        if (std::min(refDiffs, spliceDiffs) * 5 >= genome.size() * 4) {
+            out.push_back(LITERAL);
+            putVarint(out, genome.size());
+            for (const Gene &gene : genome) {
+                putGene(out, gene);
+            }
+        } else if (ref2 != ref) {
+            spliceBase(previousGenomes[ref], &previousGenomes[ref2], start, count, genome.size(), base);
+            out.push_back(SPLICE);
+            putVarint(out, ref);
+            putVarint(out, ref2);
+            putVarint(out, start);
+            putVarint(out, count);
+            putVarint(out, genome.size());
+            putDiffs(out, genome, base, spliceDiffs);
+        } else {
+            spliceBase(previousGenomes[ref], nullptr, 0, 0, genome.size(), base);
+            out.push_back(DELTA);
+            putVarint(out, ref);
+            putVarint(out, genome.size());
+            putDiffs(out, genome, base, refDiffs);
+        }
+    }
+
+    // The next block refers to this one
+    std::swap(previousGenomes, currentGenomes);
+    refByFingerprint.clear();
+    for (size_t n = 0; n < fingerprints.size(); ++n) {
+        refByFingerprint.emplace(fingerprints[n], n);
+    }
+    archiveStarted = true;
+    lastGeneration = generation;
+
+    IndexRecord record { generation, keyframeGeneration, 0, out.size(), 0, genomes.size() };
+    archiveWriter.enqueue(std::move(out), record, restart, p.logDir);
+}
+
+
+// Decodes the blocks of an archive in order
+struct ArchiveDecoder {
+    const uint8_t *next;
+    const uint8_t *end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (next == end) {
+                ok = false;
+                return 0;
+            }
+            const uint8_t byte = *next++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    Gene gene() {
+        Gene gene {};
+        if (end - next < (ptrdiff_t)sizeof(Gene)) {
+            ok = false;
+            return gene;
+        }
+        std::memcpy(&gene, next, sizeof(Gene));
+        next += sizeof(Gene);
+        return gene;
+    }
+
+    // Returns genome ref of the previous or the current block
+    const Genome *reference(const std::vector<Genome> &previous, const std::vector<Genome> &current,
+                            size_t numCurrent) {
+        const uint64_t ref = varint();
+        if (ref < previous.size()) {
+            return &previous[ref];
+        }
+        if (ref - previous.size() < numCurrent) {
+            return &current[ref - previous.size()];
+        }
+        ok = false;
+        return nullptr;
+    }
+
+    // Replaces genomes, which holds the previous block, with the next block,
+    // which the index says has numGenomes genomes
+    void block(unsigned &generation, std::vector<Genome> &genomes, uint64_t numGenomes) {
+        const Params &p = *world->params;
+        generation = varint();
+        const bool keyframe = ok && next != end && *next++ != 0;
+        const uint64_t count = varint();
+        if (!ok || count != numGenomes) {
+            ok = false;
+            return;
+        }
+        if (keyframe) {
+            genomes.clear();
+        }
+        std::vector<Genome> current(count);
+        for (size_t n = 0; n < count; ++n) {
+            Genome &genome = current[n];
+            const uint8_t encoding = next != end ? *next++ : 0xff;
+            if (encoding == LITERAL) {
+                const uint64_t length = varint();
+                if (length > p.genomeMaxLength) {
+                    ok = false;
+                    return;
+                }
+                genome.resize(length);
+                for (Gene &gene : genome) {
+                    gene = this->gene();
+                }
+            } else if (encoding == DUPLICATE) {
+                const Genome *ref = reference(genomes, current, n);
+                if (ref != nullptr) {
+                    genome = *ref;
+                }
+            } else if (encoding == DELTA || encoding == SPLICE) {
+                const Genome *ref = reference(genomes, current, n);
+                const Genome *ref2 = nullptr;
+                uint64_t start = 0;
+                uint64_t spliceCount = 0;
+                if (encoding == SPLICE) {
+                    ref2 = reference(genomes, current, n);
+                    start = varint();
+                    spliceCount = varint();
+                }
+                const uint64_t length = varint();
+                if (!ok || length > p.genomeMaxLength || start > length) {
+                    ok = false;
+                    return;
+                }
+                spliceBase(*ref, ref2, start, std::min(spliceCount, length), length, genome);
+                uint64_t numDiffs = varint();
+                uint64_t position = 0;
+                while (ok && numDiffs-- > 0) {
+                    position += varint();
+                    if (position >= genome.size()) {
+                        ok = false;
+                        break;
+                    }
+                    genome[position] = this->gene();
+                }
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                return;
+            }
+        }
+        genomes = std::move(current);
+    }
+};
+
+
+// Reads back the survivors of one generation from the archive in dir.
+// Only the blocks from the generation's keyframe onward are read. Returns
+// false if the generation is not in the archive or the archive is damaged.
+// May be called while the archive is being written.
+bool readArchivedGenomes(const std::string &dir, unsigned generation, std::vector<Genome> &genomes)
+{
+    // The records from the generation's keyframe through the generation
+    std::ifstream index(dir + "/genome-archive.idx", std::ios::binary);
+    IndexRecord first;
+    IndexRecord record;
+    if (!index.read((char *)&first, sizeof(first)) || generation < first.generation
+            || !index.seekg((uint64_t)(generation - first.generation) * sizeof(IndexRecord))
+            || !index.read((char *)&record, sizeof(record)) || record.generation != generation
+            || record.keyframeGeneration > generation || record.keyframeGeneration < first.generation) {
+        return false;
+    }
+    std::vector<IndexRecord> records(generation - record.keyframeGeneration + 1);
+    index.seekg((uint64_t)(record.keyframeGeneration - first.generation) * sizeof(IndexRecord));
+    if (!index.read((char *)records.data(), records.size() * sizeof(IndexRecord))) {
+        return false;
+    }
+
+    std::ifstream data(dir + "/genome-archive.bin", std::ios::binary);
+    char magic[sizeof(archiveMagic)];
+    uint32_t version = 0;
+    data.read(magic, sizeof(magic));
+    data.read((char *)&version, sizeof(version));
+    if (!data || std::memcmp(magic, archiveMagic, sizeof(magic)) != 0 || version != archiveVersion) {
+        std::cerr << "Genome archive in " << dir << " is not a version "
+                  << archiveVersion << " archive" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> bytes(record.offset + record.size - record.keyframeOffset);
+    data.seekg(record.keyframeOffset);
+    data.read((char *)bytes.data(), bytes.size());
+    if (!data) {
+        return false;
+    }
+
+    ArchiveDecoder decoder { bytes.data(), bytes.data() + bytes.size() };
+    genomes.clear();
+    unsigned blockGeneration = 0;
+    for (const IndexRecord &blockRecord : records) {
+        decoder.block(blockGeneration, genomes, blockRecord.numGenomes);
+        if (!decoder.ok || blockGeneration != blockRecord.generation) {
+            break;
+        }
+    }
+
+    if (!decoder.ok || blockGeneration != generation || decoder.next != decoder.end) {
+        std::cerr << "Genome archive in " << dir << " is damaged at generation " << generation << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // end namespace BS
@@ -1,128 +1,201 @@
 // genome-compare.cpp -- compute similarity of two genomes
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <vector>
+#include <utility>
 #include "simulator.h"
 
 namespace BS {
 
-// Approximate gene match: Has to match same source, sink, with similar weight
-//
-bool genesMatch(const Gene &g1, const Gene &g2)
+// Genes are compared as whole 32-bit symbols. The similarity is
+// 2 * LCS / (length1 + length2), where LCS is the length of the longest
+// common subsequence of the two gene strings, so it tolerates insertions,
+// deletions, and genomes of unequal lengths. The LCS comes from Hyyrö's
+// bit-parallel algorithm: the shorter genome is the bit vector, 64 genes
+// per word, and each gene of the longer one updates the whole vector with a
+// few word operations. Genes of the longer genome that the shorter one lacks
+// are skipped after one hash lookup. Genomes up to lcsStackGenes genes are
+// compared with scratch space on the stack only; longer ones use per-thread
+// buffers.
+
+constexpr unsigned lcsStackGenes = 384;
+
+// Scratch space for lcsLength(). matchMasks holds, for each distinct gene of
+// the shorter genome, a bit mask of where it occurs; the hash table, with
+// linear probing, maps genes to their mask.
+struct LcsTableSlot {
+    uint32_t gene;
+    int32_t mask;           // index into matchMasks, -1 if the slot is empty
+};
+
+struct LcsScratch {
+    uint64_t *matchMasks;   // numWords per distinct gene
+    uint64_t *vector;       // numWords
+    LcsTableSlot *table;    // 1 << tableBits, at least twice the shorter length
+    unsigned tableBits;
+};
+
+static unsigned lcsTableSlot(uint32_t gene, unsigned tableBits)
 {
-    return g1.sinkNum == g2.sinkNum
-        && g1.sourceNum == g2.sourceNum
-        && g1.sinkType == g2.sinkType
-        && g1.sourceType == g2.sourceType
-        && g1.weight == g2.weight;
+    return (gene * 0x9e3779b97f4a7c15ULL) >> (64 - tableBits);
 }
 
 
-// The jaro_winkler_distance() function is adapted from the C version at
-// https://github.com/miguelvps/c/blob/master/jarowinkler.c
-// under a GNU license, ver. 3. This comparison function is useful if
-// the simulator allows genomes to change length, or if genes are allowed
-// to relocate to different offsets in the genome. I.e., this function is
-// tolerant of gaps, relocations, and genomes of unequal lengths.
-//
-float jaro_winkler_distance(const Genome &genome1, const Genome &genome2) {
-    float dw;
-    auto max = [](int a, int b) { return a > b ? a : b; };
-    auto min = [](int a, int b) { return a < b ? a : b; };
+// Returns the length of the longest common subsequence of a[0..lengthA) and
+// b[0..lengthB), with lengthB <= lengthA
+static unsigned lcsLength(const uint32_t *a, unsigned lengthA, const uint32_t *b, unsigned lengthB,
+                          LcsScratch &scratch)
+{
+    const unsigned numWords = (lengthB + 63) / 64;
+    const unsigned tableMask = (1U << scratch.tableBits) - 1;
+    LcsTableSlot *table = scratch.table;
+    std::fill_n(table, tableMask + 1, LcsTableSlot { 0, -1 });
 
-    const auto &s = genome1;
-    const auto &a = genome2;
+    int32_t numMasks = 0;
+    for (unsigned j = 0; j < lengthB; ++j) {
+        unsigned slot = lcsTableSlot(b[j], scratch.tableBits);
+        while (table[slot].mask >= 0 && table[slot].gene != b[j]) {
+            slot = (slot + 1) & tableMask;
+        }
+        if (table[slot].mask < 0) {
+            table[slot] = { b[j], numMasks++ };
+            std::fill_n(&scratch.matchMasks[table[slot].mask * numWords], numWords, 0);
+        }
+        scratch.matchMasks[table[slot].mask * numWords + j / 64] |= 1ULL << (j % 64);
+    }
 
-    int i, j, l;
-    int m = 0, t = 0;
-    int sl = s.size(); // strlen(s);
-    int al = a.size(); // strlen(a);
+    // Each zero bit of the vector is one gene of the LCS. A gene of a that
+    // does not occur in b leaves the vector unchanged.
+    uint64_t *v = scratch.vector;
+    std::fill_n(v, numWords, ~0ULL);
+    for (unsigned i = 0; i < lengthA; ++i) {
+        unsigned slot = lcsTableSlot(a[i], scratch.tableBits);
+        while (table[slot].mask >= 0 && table[slot].gene != a[i]) {
+            slot = (slot + 1) & tableMask;
+        }
+        if (table[slot].mask < 0) {
+            continue;
+        }
+        const uint64_t *match = &scratch.matchMasks[table[slot].mask * numWords];
+        uint64_t carry = 0;
+        for (unsigned k = 0; k < numWords; ++k) {
+            const uint64_t u = v[k] & match[k];
+            uint64_t sum;
+            const bool carry1 = __builtin_add_overflow(v[k], carry, &sum);
+            const bool carry2 = __builtin_add_overflow(sum, u, &sum);
+            carry = carry1 | carry2;
+            v[k] = sum | (v[k] & ~match[k]);
+        }
+    }
 
-    constexpr unsigned maxNumGenesToCompare = 20;
-    sl = min(maxNumGenesToCompare, sl); // optimization: approximate for long genomes
-    al = min(maxNumGenesToCompare, al);
+    unsigned ones = 0;
+    for (unsigned k = 0; k < numWords; ++k) {
+        const uint64_t valid = (k + 1 < numWords || lengthB % 64 == 0) ? ~0ULL : (1ULL << (lengthB % 64)) - 1;
+        ones += __builtin_popcountll(v[k] & valid);
+    }
+    return lengthB - ones;
+}
 
-    std::vector<int> sflags(sl, 0);
-    std::vector<int> aflags(al, 0);
-    int range = max(0, max(sl, al) / 2 - 1);
 
-    if (!sl || !al)
-        return 0.0;
+// Returns 0.0..1.0; 1.0 if both genomes are empty
+float lcsSimilarity(const Genome &genome1, const Genome &genome2)
+{
+    const Genome &longer = genome1.size() >= genome2.size() ? genome1 : genome2;
+    const Genome &shorter = genome1.size() >= genome2.size() ? genome2 : genome1;
+    const unsigned lengthA = longer.size();
+    const unsigned lengthB = shorter.size();
+    if (lengthB == 0) {
+        return lengthA == 0 ? 1.0 : 0.0;
+    }
+    const uint32_t *a = (const uint32_t *)longer.data();
+    const uint32_t *b = (const uint32_t *)shorter.data();
 
-    /* calculate matching characters */
-    for (i = 0; i < al; i++) {
-        for (j = max(i - range, 0), l = min(i + range + 1, sl); j < l; j++) {
-            if (genesMatch(a[i], s[j]) && !sflags[j]) {
-                sflags[j] = 1;
-                aflags[i] = 1;
-                m++;
-                break;
-            }
-        }
+    unsigned tableBits = 4;
+    while ((1U << tableBits) < 2 * lengthB) {
+        ++tableBits;
     }
+    const unsigned numWords = (lengthB + 63) / 64;
+    unsigned lcs;
 
-    if (!m)
-        return 0.0;
+    if (lengthB <= lcsStackGenes) {
+        constexpr unsigned maxWords = (lcsStackGenes + 63) / 64;
+        constexpr unsigned maxTableSize = 1024; // >= 2 * lcsStackGenes
+        uint64_t matchMasks[lcsStackGenes * maxWords];
+        uint64_t vector[maxWords];
+        LcsTableSlot table[maxTableSize];
+        LcsScratch scratch { matchMasks, vector, table, tableBits };
+        lcs = lcsLength(a, lengthA, b, lengthB, scratch);
+    } else {
+        thread_local std::vector<uint64_t> matchMasks;
+        thread_local std::vector<uint64_t> vector;
+        thread_local std::vector<LcsTableSlot> table;
+        matchMasks.resize((size_t)lengthB * numWords);
+        vector.resize(numWords);
+        table.resize(1U << tableBits);
+        LcsScratch scratch { matchMasks.data(), vector.data(), table.data(), tableBits };
+        lcs = lcsLength(a, lengthA, b, lengthB, scratch);
+    }
 
-    /* calculate character transpositions */
-    l = 0;
-    for (i = 0; i < al; i++) {
-        if (aflags[i] == 1) {
-            for (j = l; j < sl; j++) {
-                if (sflags[j] == 1) {
-                    l = j + 1;
-                    break;
-                }
-            }
-            if (!genesMatch(a[i], s[j]))
-                t++;
-        }
+    return 2.0f * lcs / (float)(lengthA + lengthB);
+}
+
+
+// Converts a count of differing bits to a 0.0..1.0 similarity. Genomes of
+// unequal length are aligned at their first gene: diffBits counts only the
+// genes both genomes have, and each gene that only the longer one has counts
+// as differing in half its bits, as an unrelated gene would on average.
+static float hammingSimilarity(unsigned diffBits, unsigned length1, unsigned length2)
+{
+    const unsigned longer = std::max(length1, length2);
+    const unsigned extraGenes = longer - std::min(length1, length2);
+    const unsigned lengthBits = longer * sizeof(Gene) * 8;
+    if (lengthBits == 0) {
+        return 1.0;
     }
-    t /= 2;
 
-    /* Jaro distance */
-    dw = (((float)m / sl) + ((float)m / al) + ((float)(m - t) / m)) / 3.0f;
-    return dw;
+    // For two completely random bit patterns, about half the bits will differ,
+    // resulting in c. 50% match. We will scale that by 2X to make the range
+    // from 0 to 1.0. We clip the value to 1.0 in case the two patterns are
+    // negatively correlated for some reason.
+    const double scaledDiff = 2.0 * diffBits + (double)extraGenes * sizeof(Gene) * 8;
+    return 1.0 - std::min(1.0, scaledDiff / (float)lengthBits);
 }
 
 
-// Works only for genomes of equal length
+// Genomes of unequal length are aligned as in hammingSimilarity()
 float hammingDistanceBits(const Genome &genome1, const Genome &genome2)
 {
-    assert(genome1.size() == genome2.size());
-
     const unsigned int *p1 = (const unsigned int *)genome1.data();
     const unsigned int *p2 = (const unsigned int *)genome2.data();
-    const unsigned numElements = genome1.size();
-    const unsigned bytesPerElement = sizeof(genome1[0]);
-    const unsigned lengthBytes = numElements * bytesPerElement;
-    const unsigned lengthBits = lengthBytes * 8;
+    const unsigned numShared = std::min(genome1.size(), genome2.size());
     unsigned bitCount = 0;
 
-    for (unsigned index = 0; index < genome1.size(); ++p1, ++p2, ++index) {
+    for (unsigned index = 0; index < numShared; ++p1, ++p2, ++index) {
         bitCount += __builtin_popcount(*p1 ^ *p2);
     }
 
-    // For two completely random bit patterns, about half the bits will differ,
-    // resulting in c. 50% match. We will scale that by 2X to make the range
-    // from 0 to 1.0. We clip the value to 1.0 in case the two patterns are
-    // negatively correlated for some reason.
-    return 1.0 - std::min(1.0, (2.0 * bitCount) / (float)lengthBits);
+    return hammingSimilarity(bitCount, genome1.size(), genome2.size());
 }
 
 
-// Works only for genomes of equal length
+// Genomes of unequal length are aligned at their first gene; the genes that
+// only the longer one has never match
 float hammingDistanceBytes(const Genome &genome1, const Genome &genome2)
 {
-    assert(genome1.size() == genome2.size());
-
     const unsigned int *p1 = (const unsigned int *)genome1.data();
     const unsigned int *p2 = (const unsigned int *)genome2.data();
-    const unsigned numElements = genome1.size();
+    const unsigned numShared = std::min(genome1.size(), genome2.size());
+    const unsigned numElements = std::max(genome1.size(), genome2.size());
     const unsigned bytesPerElement = sizeof(genome1[0]);
     const unsigned lengthBytes = numElements * bytesPerElement;
     unsigned byteCount = 0;
 
-    for (unsigned index = 0; index < genome1.size(); ++p1, ++p2, ++index) {
+    if (lengthBytes == 0) {
+        return 1.0;
+    }
+    for (unsigned index = 0; index < numShared; ++p1, ++p2, ++index) {
         byteCount += (unsigned)(*p1 == *p2);
     }
 
@@ -135,9 +208,10 @@ float hammingDistanceBytes(const Genome &genome1, const Genome &genome2)
 // ToDo: optimize by approximation for long genomes
 float genomeSimilarity(const Genome &g1, const Genome &g2)
 {
+    const Params &p = *world->params;
     switch (p.genomeComparisonMethod) {
     case 0:
-        return jaro_winkler_distance(g1, g2);
+        return lcsSimilarity(g1, g2);
     case 1:
         return hammingDistanceBits(g1, g2);
     case 2:
@@ -148,10 +222,103 @@ float genomeSimilarity(const Genome &g1, const Genome &g2)
 }
 
 
+// FNV-1a over the 32-bit gene words, followed by a final avalanche so that
+// the low bits are usable directly as a hash table index.
+uint64_t genomeFingerprint(const Genome &genome)
+{
+    assert(sizeof(Gene) == 4);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const Gene &gene : genome) {
+        uint32_t n;
+        std::memcpy(&n, &gene, sizeof(n));
+        hash = (hash ^ n) * 0x100000001b3ULL;
+    }
+    hash ^= genome.size();
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+
+// Memo table of exact similarity scores keyed by the (unordered) pair of
+// genome fingerprints. Clones share fingerprints, so they also share table
+// entries. Slots are invalidated in O(1) by advancing the epoch rather than
+// by clearing the table. The table is sized once per generation and never
+// grows on the sim step path; if all the probed slots are taken, the first
+// one is overwritten. Each world is stepped on its own thread, so each
+// thread keeps its own table.
+struct SimilarityCacheSlot {
+    uint64_t fingerprint1;
+    uint64_t fingerprint2;
+    uint32_t epoch;         // slot is valid only if equal to similarityCacheEpoch
+    float similarity;
+};
+
+thread_local std::vector<SimilarityCacheSlot> similarityCache;
+thread_local uint32_t similarityCacheEpoch = 0;
+constexpr unsigned similarityCacheProbes = 8;
+
+
+// Must be called in single-thread mode between generations
+void clearGenomeSimilarityCache()
+{
+    const Params &p = *world->params;
+    size_t size = 1024;
+    while (size < 4 * (size_t)p.population) {
+        size <<= 1;
+    }
+
+    if (similarityCache.size() != size || ++similarityCacheEpoch == 0) {
+        similarityCache.assign(size, SimilarityCacheSlot { 0, 0, 0, 0.0f });
+        similarityCacheEpoch = 1;
+    }
+}
+
+
+// Returns 0.0..1.0, the same value as genomeSimilarity(g1, g2), but looks
+// it up in the memo table first. Not thread-safe.
+float genomeSimilarity(uint64_t fingerprint1, const Genome &g1,
+                       uint64_t fingerprint2, const Genome &g2)
+{
+    if (similarityCache.empty()) {
+        return genomeSimilarity(g1, g2);
+    }
+
+    // Order the pair so that (g1, g2) and (g2, g1) share a slot and a score
+    const Genome *genome1 = &g1;
+    const Genome *genome2 = &g2;
+    if (fingerprint1 > fingerprint2) {
+        std::swap(fingerprint1, fingerprint2);
+        std::swap(genome1, genome2);
+    }
+
+    const size_t mask = similarityCache.size() - 1;
+    const size_t start = (fingerprint1 ^ (fingerprint2 * 0x9e3779b97f4a7c15ULL)) & mask;
+    SimilarityCacheSlot *victim = &similarityCache[start];
+
+    for (unsigned probe = 0; probe < similarityCacheProbes; ++probe) {
+        SimilarityCacheSlot &slot = similarityCache[(start + probe) & mask];
+        if (slot.epoch != similarityCacheEpoch) {
+            victim = &slot; // empty slot
+            break;
+        }
+        if (slot.fingerprint1 == fingerprint1 && slot.fingerprint2 == fingerprint2) {
+            return slot.similarity;
+        }
+    }
+
+    float similarity = genomeSimilarity(*genome1, *genome2);
+    *victim = { fingerprint1, fingerprint2, similarityCacheEpoch, similarity };
+    return similarity;
+}
+
+
 // returns 0.0..1.0
 // Samples random pairs of individuals regardless if they are alive or not
 float geneticDiversity()
 {
+    const Params &p = *world->params;
+    const Peeps &peeps = world->peeps;
     if (p.population < 2) {
         return 0.0;
     }
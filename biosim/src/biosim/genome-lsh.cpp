@@ -0,0 +1,132 @@
+// genome-lsh.cpp -- locality-sensitive hash index for finding similar genomes
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include "simulator.h"
+
+namespace BS {
+
+// Returns bit number bitNum of the genome viewed as a string of 32-bit
+// gene words. Bits past the end of a short genome read as zero.
+static unsigned genomeBit(const Genome &genome, uint32_t bitNum)
+{
+    const uint32_t geneNum = bitNum / 32;
+    if (geneNum >= genome.size()) {
+        return 0;
+    }
+    uint32_t word;
+    std::memcpy(&word, &genome[geneNum], sizeof(word));
+    return (word >> (bitNum % 32)) & 1;
+}
+
+
+unsigned GenomeLshIndex::keyOf(const Genome &genome, const GenomeSketch &sketch, unsigned table) const
+{
+    if (bySketch) {
+        uint64_t band = 0;
+        for (unsigned slot = table * slotsPerBand; slot < (table + 1) * slotsPerBand; ++slot) {
+            band = (band ^ sketch[slot]) * 0x9e3779b97f4a7c15ULL;
+        }
+        return band >> (64 - bitsPerKey);
+    }
+
+    unsigned key = 0;
+    for (unsigned bit = 0; bit < bitsPerKey; ++bit) {
+        key = (key << 1) | genomeBit(genome, bitPositions[table * bitsPerKey + bit]);
+    }
+    return key;
+}
+
+
+// With the Hamming measures, bit-sampling LSH: each of the numBitTables
+// tables keys a genome by bitsPerKey of its bits, chosen at random from the
+// bits of the genes that all the genomes have. Two genomes that differ in a
+// fraction d of those bits share a bucket in a given table with
+// probability (1-d)^bitsPerKey. With 12 bits
+// and 20 tables, a pair at the 0.7 kinship threshold of the Hamming measure
+// (d = 0.15) shows up as a candidate about 95% of the time, while unrelated
+// genomes (d = 0.5) almost never do. The bit positions come from a fixed
+// RNG stream so that building an index does not disturb randomUint.
+//
+// Bit positions only line up if the genes do, so with genomeComparisonMethod
+// 0 (longest common subsequence), where kin may have genes inserted or
+// deleted, each of the numBands tables instead keys a genome by a band of
+// slotsPerBand slots of its sketch. Two genomes whose gene sets have a
+// Jaccard similarity J share a bucket in a given table with probability
+// J^slotsPerBand. Point mutations to a fraction m of the genes leave an LCS
+// similarity of about 1 - m and a J of about (1 - m) / (1 + m), so a pair
+// at the 0.7 threshold (J = 0.54) shows up as a candidate over 99% of the
+// time, however its genes are shifted.
+void GenomeLshIndex::build(const std::vector<const Genome *> &genomes,
+                           const std::vector<const GenomeSketch *> &sketches)
+{
+    const Params &p = *world->params;
+    assert(sketches.size() == genomes.size());
+    numGenomes = genomes.size();
+    bySketch = (p.genomeComparisonMethod == 0);
+    numTables = bySketch ? numBands : numBitTables;
+
+    if (!bySketch) {
+        size_t shortest = p.genomeMaxLength;
+        for (const Genome *genome : genomes) {
+            shortest = std::min(shortest, genome->size());
+        }
+        const uint32_t numBits = 32 * std::max<size_t>(1, shortest);
+
+        RandomUintGenerator rng;
+        rng.initialize(0x6c5ce11dU, numBits);
+        bitPositions.resize(numTables * bitsPerKey);
+        for (uint32_t &position : bitPositions) {
+            position = rng(0, numBits - 1);
+        }
+    }
+
+    // One counting sort per table: bucketStart[] holds the offset of each
+    // bucket's run of genome numbers in entries[]
+    constexpr unsigned numBuckets = 1u << bitsPerKey;
+    bucketStart.assign(numTables * (numBuckets + 1), 0);
+    entries.resize(numTables * numGenomes);
+    keys.resize(numGenomes);
+    std::vector<uint32_t> next(numBuckets);
+
+    for (unsigned table = 0; table < numTables; ++table) {
+        uint32_t *start = &bucketStart[table * (numBuckets + 1)];
+        for (size_t n = 0; n < numGenomes; ++n) {
+            keys[n] = keyOf(*genomes[n], *sketches[n], table);
+            ++start[keys[n] + 1];
+        }
+        for (unsigned bucket = 0; bucket < numBuckets; ++bucket) {
+            start[bucket + 1] += start[bucket];
+        }
+        std::copy(start, start + numBuckets, next.begin());
+        for (size_t n = 0; n < numGenomes; ++n) {
+            entries[table * numGenomes + next[keys[n]]++] = n;
+        }
+    }
+}
+
+
+// Fills candidates with the sorted, unique numbers of the indexed genomes
+// that share a bucket with genome in at least one table. Candidates are
+// only likely kin; callers verify them with genomeSimilarity().
+void GenomeLshIndex::findCandidates(const Genome &genome, const GenomeSketch &sketch,
+                                    std::vector<uint32_t> &candidates) const
+{
+    candidates.clear();
+    if (numGenomes == 0) {
+        return;
+    }
+
+    constexpr unsigned numBuckets = 1u << bitsPerKey;
+    for (unsigned table = 0; table < numTables; ++table) {
+        const uint32_t *start = &bucketStart[table * (numBuckets + 1)];
+        const unsigned key = keyOf(genome, sketch, table);
+        const uint32_t *first = &entries[table * numGenomes];
+        candidates.insert(candidates.end(), first + start[key], first + start[key + 1]);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
+} // end namespace BS
@@ -0,0 +1,149 @@
+// genome-sketch.cpp -- MinHash sketches and population diversity estimates
+
+// Each individual carries a MinHash sketch of the set of genes in its genome,
+// made when it is spawned (see Indiv::initialize()). Slot k of the sketch is
+// the smallest value of hash function k over the genome's genes, so two
+// sketches agree in a slot with probability equal to the Jaccard similarity
+// of the two gene sets: the genes they share over the genes either has.
+//
+// estimateDiversity() turns the sketches into the mean Jaccard similarity of
+// every pair in the population without looking at any pair: in each slot,
+// the pairs that agree are the pairs within each group of equal values, so
+// counting the values gives the fraction of agreeing pairs directly. For a
+// given population, the slots are independent estimates of the same mean,
+// so their spread gives a confidence bound. The cost is proportional to the
+// population times genomeSketchSize, whatever the genome length.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+// Hash function k maps a gene's mixed bits h to the high half of
+// h * multipliers[k] + addends[k]. The constants come from a fixed
+// splitmix64 stream so that sketches never draw from randomUint.
+struct SketchHashes {
+    uint64_t multipliers[genomeSketchSize];
+    uint64_t addends[genomeSketchSize];
+};
+
+static constexpr uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static constexpr SketchHashes makeSketchHashes()
+{
+    SketchHashes hashes {};
+    uint64_t state = 0x6a09e667f3bcc908ULL;
+    for (unsigned k = 0; k < genomeSketchSize; ++k) {
+        hashes.multipliers[k] = splitmix64(state) | 1;
+        hashes.addends[k] = splitmix64(state);
+    }
+    return hashes;
+}
+
+static constexpr SketchHashes sketchHashes = makeSketchHashes();
+
+
+// An empty genome gets all slots at the maximum value
+void genomeSketch(const Genome &genome, GenomeSketch &sketch)
+{
+    sketch.fill(std::numeric_limits<uint32_t>::max());
+    for (const Gene &gene : genome) {
+        uint32_t n;
+        std::memcpy(&n, &gene, sizeof(n));
+        uint64_t state = n;
+        const uint64_t mixed = splitmix64(state);
+        for (unsigned k = 0; k < genomeSketchSize; ++k) {
+            const uint32_t h = (mixed * sketchHashes.multipliers[k] + sketchHashes.addends[k]) >> 32;
+            sketch[k] = std::min(sketch[k], h);
+        }
+    }
+}
+
+
+// Groups equal keys in an open-addressing table of (key, count). Returns the
+// number of distinct keys and the number of pairs of equal keys.
+static unsigned countEqualKeys(const std::vector<uint64_t> &keys,
+                               std::vector<std::pair<uint64_t, uint32_t>> &table,
+                               double &equalPairs)
+{
+    size_t size = 16;
+    while (size < 2 * keys.size()) {
+        size <<= 1;
+    }
+    table.assign(size, { 0, 0 });
+    const size_t mask = size - 1;
+
+    unsigned numDistinct = 0;
+    equalPairs = 0.0;
+    for (uint64_t key : keys) {
+        size_t slot = (key * 0x9e3779b97f4a7c15ULL) >> 32 & mask;
+        while (table[slot].second != 0 && table[slot].first != key) {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot].second == 0) {
+            table[slot].first = key;
+            ++numDistinct;
+        }
+        equalPairs += table[slot].second++; // pairs with the equal keys before it
+    }
+    return numDistinct;
+}
+
+
+// Covers every individual, alive or not, like geneticDiversity(). Must be
+// called between generations.
+DiversityEstimate estimateDiversity()
+{
+    const Params &p = *world->params;
+    DiversityEstimate estimate;
+    const Peeps &peeps = world->peeps;
+    const unsigned population = p.population;
+    if (population < 2) {
+        return estimate;
+    }
+
+    std::vector<uint64_t> keys(population);
+    std::vector<std::pair<uint64_t, uint32_t>> table;
+    double equalPairs;
+
+    for (unsigned index = 1; index <= population; ++index) {
+        keys[index - 1] = peeps[index].fingerprint;
+    }
+    estimate.distinctGenotypes = countEqualKeys(keys, table, equalPairs);
+
+    // The fraction of agreeing pairs in each slot, then their mean and the
+    // standard error of the mean
+    const double numPairs = (double)population * (population - 1) / 2.0;
+    double slotSimilarity[genomeSketchSize];
+    double sum = 0.0;
+    for (unsigned k = 0; k < genomeSketchSize; ++k) {
+        for (unsigned index = 1; index <= population; ++index) {
+            keys[index - 1] = peeps[index].sketch[k];
+        }
+        countEqualKeys(keys, table, equalPairs);
+        slotSimilarity[k] = equalPairs / numPairs;
+        sum += slotSimilarity[k];
+    }
+    const double mean = sum / genomeSketchSize;
+    double sumSquares = 0.0;
+    for (unsigned k = 0; k < genomeSketchSize; ++k) {
+        sumSquares += (slotSimilarity[k] - mean) * (slotSimilarity[k] - mean);
+    }
+    const double standardError = std::sqrt(sumSquares / (genomeSketchSize - 1) / genomeSketchSize);
+
+    estimate.diversity = 1.0 - mean;
+    estimate.bound = 1.96 * standardError; // 95%, normal approximation
+    return estimate;
+}
+
+} // end namespace BS
@@ -5,6 +5,8 @@
 #include <list>
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <cmath>
 #include <string>
 #include "simulator.h"
 #include "random.h"
@@ -56,6 +58,7 @@ Gene makeRandomGene()
 // Returns by value a single genome with random genes.
 Genome makeRandomGenome()
 {
+    const Params &p = *world->params;
     Genome genome;
 
     unsigned length = randomUint(p.genomeInitialLengthMin, p.genomeInitialLengthMax);
@@ -74,6 +77,7 @@ Genome makeRandomGenome()
 // Actions are renumbered 0..Action::NUM_ACTIONS - 1
 void makeRenumberedConnectionList(ConnectionList &connectionList, const Genome &genome)
 {
+    const Params &p = *world->params;
     connectionList.clear();
     for (auto const &gene : genome) {
         connectionList.push_back(gene);
@@ -99,6 +103,7 @@ void makeRenumberedConnectionList(ConnectionList &connectionList, const Genome &
 // outputs each neuron has.
 void makeNodeList(NodeMap &nodeMap, const ConnectionList &connectionList)
 {
+    const Params &p = *world->params;
     nodeMap.clear();
 
     for (const Gene &conn : connectionList) {
@@ -164,6 +169,7 @@ void removeConnectionsToNeuron(ConnectionList &connections, NodeMap &nodeMap, ui
 // different neuron having no outputs.
 void cullUselessNeurons(ConnectionList &connections, NodeMap &nodeMap)
 {
+    const Params &p = *world->params;
     bool allDone = false;
     while (!allDone) {
         allDone = true;
@@ -196,6 +202,7 @@ void cullUselessNeurons(ConnectionList &connections, NodeMap &nodeMap)
 // 3. Renumber the remaining neurons sequentially starting at 0.
 void Indiv::createWiringFromGenome()
 {
+    const Params &p = *world->params;
     NodeMap nodeMap;  // list of neurons and their number of inputs and outputs
     ConnectionList connectionList; // synaptic connections
 
@@ -262,19 +269,45 @@ void Indiv::createWiringFromGenome()
 }
 
 
+void WiringArena::append(const NeuralNet &nnet)
+{
+    connections.append(nnet.connections);
+    neuronSpans.push_back( { (uint32_t)driven.size(), (uint32_t)nnet.neurons.size() } );
+    for (const NeuralNet::Neuron &neuron : nnet.neurons) {
+        driven.push_back(neuron.driven);
+    }
+}
+
+
+// The copy starts with fresh neuron outputs, the same as a net built by
+// createWiringFromGenome(). Reuses the capacity of nnet's containers.
+void WiringArena::copyTo(size_t index, NeuralNet &nnet) const
+{
+    const GenomeView conns = connections[index];
+    nnet.connections.assign(conns.begin(), conns.end());
+
+    const Span &span = neuronSpans[index];
+    nnet.neurons.resize(span.length);
+    for (unsigned neuronNum = 0; neuronNum < span.length; ++neuronNum) {
+        nnet.neurons[neuronNum].output = initialNeuronOutput();
+        nnet.neurons[neuronNum].driven = driven[span.offset + neuronNum];
+    }
+}
+
+
 // ---------------------------------------------------------------------------
 
 
-// This applies a point mutation at a random bit in a genome.
-void randomBitFlip(Genome &genome)
+// This applies a point mutation at a random bit in the gene at elementIndex.
+void randomBitFlip(Genome &genome, unsigned elementIndex)
 {
     int method = 1;
 
-    unsigned byteIndex = randomUint(0, genome.size() - 1) * sizeof(Gene);
-    unsigned elementIndex = randomUint(0, genome.size() - 1);
+    assert(elementIndex < genome.size());
     uint8_t bitIndex8 = 1 << randomUint(0, 7);
 
     if (method == 0) {
+        unsigned byteIndex = elementIndex * sizeof(Gene) + randomUint(0, sizeof(Gene) - 1);
         ((uint8_t *)&genome[0])[byteIndex] ^= bitIndex8;
     } else if (method == 1) {
         float chance = randomUint() / (float)RANDOM_UINT_MAX; // 0..1
@@ -319,6 +352,7 @@ void cropLength(Genome &genome, unsigned length)
 // unequal lengths during a simulation.
 void randomInsertDeletion(Genome &genome)
 {
+    const Params &p = *world->params;
     float probability = p.geneInsertionDeletionRate;
     if (randomUint() / (float)RANDOM_UINT_MAX < probability) {
         if (randomUint() / (float)RANDOM_UINT_MAX < p.deletionRatio) {
@@ -327,23 +361,42 @@ void randomInsertDeletion(Genome &genome)
                 genome.erase(genome.begin() + randomUint(0, genome.size() - 1));
             }
         } else if (genome.size() < p.genomeMaxLength) {
-            // insertion
-            //genome.insert(genome.begin() + randomUint(0, genome.size() - 1), makeRandomGene());
-            genome.push_back(makeRandomGene());
+            // insertion at any position, including the end
+            genome.insert(genome.begin() + randomUint(0, genome.size()), makeRandomGene());
         }
     }
 }
 
 
 // This function causes point mutations in a genome with a probability defined
-// by the parameter p.pointMutationRate.
+// by the parameter p.pointMutationRate per gene. Rather than drawing a random
+// number for every gene, we draw the number of genes to skip before the next
+// mutated one from the geometric distribution, so the cost is proportional to
+// the number of mutations: usually a single draw that skips past the end.
 void applyPointMutations(Genome &genome)
 {
-    unsigned numberOfGenes = genome.size();
-    while (numberOfGenes-- > 0) {
-        if ((randomUint() / (float)RANDOM_UINT_MAX) < p.pointMutationRate) {
-            randomBitFlip(genome);
+    const Params &p = *world->params;
+    const double rate = p.pointMutationRate;
+    if (rate <= 0.0) {
+        return;
+    } else if (rate >= 1.0) {
+        for (unsigned index = 0; index < genome.size(); ++index) {
+            randomBitFlip(genome, index);
+        }
+        return;
+    }
+
+    const double logKeepRate = std::log1p(-rate);
+    size_t index = 0;
+    while (true) {
+        double uniform = (randomUint() + 1.0) / (RANDOM_UINT_MAX + 2.0); // 0..1 exclusive
+        double skip = std::floor(std::log(uniform) / logKeepRate);
+        if (skip >= genome.size() - index) {
+            break;
         }
+        index += (size_t)skip;
+        randomBitFlip(genome, index);
+        ++index;
     }
 }
 
@@ -351,12 +404,18 @@ void applyPointMutations(Genome &genome)
 // This generates a child genome from one or two parent genomes.
 // If the parameter p.sexualReproduction is true, two parents contribute
 // genes to the offspring. The new genome may undergo mutation.
-// Must be called in single-thread mode between generations
-Genome generateChildGenome(const std::vector<Genome> &parentGenomes)
+// The child is written over genome, reusing its capacity. May be called
+// from several threads at once; it draws from the calling thread's randomUint.
+// Returns the number of a parent whose genome is identical to the child's
+// (common when mutation rates are low), or -1 if there is none. Sets parents
+// to the numbers of the parents, the primary parent first: the one whose
+// genome the child's is built on. The second is -1 if there is only one.
+int generateChildGenome(const GenomeArena &parentGenomes, const AliasTable &parentSelector, Genome &genome,
+                        std::array<int, 2> &parents)
 {
+    const Params &p = *world->params;
     // random parent (or parents if sexual reproduction) with random
     // mutations
-    Genome genome;
 
     uint16_t parent1Idx;
     uint16_t parent2Idx;
@@ -366,24 +425,26 @@ Genome generateChildGenome(const std::vector<Genome> &parentGenomes)
     // all the candidate parents with equal preference. If the parameter is
     // true, then we give preference to candidate parents according to their
     // score. Their score was computed by the survival/selection algorithm
-    // in survival-criteria.cpp.
+    // in survival-criteria.cpp, and parentSelector was built from the scores
+    // (see spawnNewGeneration()).
     if (p.chooseParentsByFitness && parentGenomes.size() > 1) {
-        parent1Idx = randomUint(1, parentGenomes.size() - 1);
-        parent2Idx = randomUint(0, parent1Idx - 1);
+        assert(parentSelector.size() == parentGenomes.size());
+        parent1Idx = parentSelector.sample();
+        parent2Idx = parentSelector.sample();
     } else {
         parent1Idx = randomUint(0, parentGenomes.size() - 1);
         parent2Idx = randomUint(0, parentGenomes.size() - 1);
     }
 
-    const Genome &g1 = parentGenomes[parent1Idx];
-    const Genome &g2 = parentGenomes[parent2Idx];
+    const GenomeView g1 = parentGenomes[parent1Idx];
+    const GenomeView g2 = parentGenomes[parent2Idx];
 
     if (g1.empty() || g2.empty()) {
         std::cout << "invalid genome" << std::endl;
         assert(false);
     }
 
-    auto overlayWithSliceOf = [&](const Genome &gShorter) {
+    auto overlayWithSliceOf = [&](const GenomeView &gShorter) {
         uint16_t index0 = randomUint(0, gShorter.size() - 1);
         uint16_t index1 = randomUint(0, gShorter.size());
         if (index0 > index1) {
@@ -394,13 +455,15 @@ Genome generateChildGenome(const std::vector<Genome> &parentGenomes)
 
     if (p.sexualReproduction) {
         if (g1.size() > g2.size()) {
-            genome = g1;
+            genome.assign(g1.begin(), g1.end());
             overlayWithSliceOf(g2);
             assert(!genome.empty());
+            parents = { parent1Idx, parent2Idx };
         } else {
-            genome = g2;
+            genome.assign(g2.begin(), g2.end());
             overlayWithSliceOf(g1);
             assert(!genome.empty());
+            parents = { parent2Idx, parent1Idx };
         }
 
         // Trim to length = average length of parents
@@ -412,8 +475,9 @@ Genome generateChildGenome(const std::vector<Genome> &parentGenomes)
         cropLength(genome, sum / 2);
         assert(!genome.empty());
     } else {
-        genome = g2;
+        genome.assign(g2.begin(), g2.end());
         assert(!genome.empty());
+        parents = { parent2Idx, -1 };
     }
 
     randomInsertDeletion(genome);
@@ -422,7 +486,16 @@ Genome generateChildGenome(const std::vector<Genome> &parentGenomes)
     assert(!genome.empty());
     assert(genome.size() <= p.genomeMaxLength);
 
-    return genome;
+    auto sameAs = [&genome](const GenomeView &parent) {
+        return parent.size() == genome.size()
+            && std::memcmp(parent.begin(), genome.data(), genome.size() * sizeof(Gene)) == 0;
+    };
+    if (sameAs(g2)) {
+        return parent2Idx;
+    } else if (sameAs(g1)) {
+        return parent1Idx;
+    }
+    return -1;
 }
 
 } // end namespace BS
@@ -7,7 +7,7 @@
 
 namespace BS {
 
-float getPopulationDensityAlongAxis(Coord loc, Dir dir)
+float getPopulationDensityAlongAxis(const World &w, Coord loc, Dir dir)
 {
     // Converts the population along the specified axis to the sensor range. The
     // locations of neighbors are scaled by the inverse of their distance times
@@ -21,6 +21,7 @@ float getPopulationDensityAlongAxis(Coord loc, Dir dir)
 
     assert(dir != Compass_CENTER);  // require a defined axis
 
+    const Params &p = *w.params;
     double sum = 0.0;
     Coord dirVec = dir.asNormalizedCoord();
     double len = std::sqrt(dirVec.x * dirVec.x + dirVec.y * dirVec.y);
@@ -28,7 +29,7 @@ float getPopulationDensityAlongAxis(Coord loc, Dir dir)
     double dirVecY = dirVec.y / len; // Unit vector components along dir
 
     auto f = [&](Coord tloc) {
-        if (tloc != loc && grid.isOccupiedAt(tloc)) {
+        if (tloc != loc && w.grid.isOccupiedAt(tloc)) {
             Coord offset = tloc - loc;
             double proj = dirVecX * offset.x + dirVecY * offset.y; // Magnitude of projection along dir
             double contrib = proj / (offset.x * offset.x + offset.y * offset.y);
@@ -52,7 +53,7 @@ float getPopulationDensityAlongAxis(Coord loc, Dir dir)
 // Converts the number of locations (not including loc) to the next barrier location
 // along opposite directions of the specified axis to the sensor range. If no barriers
 // are found, the result is sensor mid-range. Ignores agents in the path.
-float getShortProbeBarrierDistance(Coord loc0, Dir dir, unsigned probeDistance)
+float getShortProbeBarrierDistance(const Grid &grid, Coord loc0, Dir dir, unsigned probeDistance)
 {
     unsigned countFwd = 0;
     unsigned countRev = 0;
@@ -85,18 +86,23 @@ float getShortProbeBarrierDistance(Coord loc0, Dir dir, unsigned probeDistance)
 }
 
 
-float getSignalDensity(unsigned layerNum, Coord loc)
+float getSignalDensity(const World &w, unsigned layerNum, Coord loc)
 {
     // returns magnitude of the specified signal layer in a neighborhood, with
     // 0.0..maxSignalSum converted to the sensor range.
 
+    const Params &p = *w.params;
+    if (!w.signals.anyActive(layerNum, loc, p.signalSensorRadius)) {
+        return 0.0; // the whole neighborhood is in cold tiles
+    }
+
     unsigned countLocs = 0;
     unsigned long sum = 0;
     Coord center = loc;
 
     auto f = [&](Coord tloc) {
         ++countLocs;
-        sum += signals.getMagnitude(layerNum, tloc);
+        sum += w.signals.getMagnitude(layerNum, tloc);
     };
 
     visitNeighborhood(center, p.signalSensorRadius, f);
@@ -107,7 +113,7 @@ float getSignalDensity(unsigned layerNum, Coord loc)
 }
 
 
-float getSignalDensityAlongAxis(unsigned layerNum, Coord loc, Dir dir)
+float getSignalDensityAlongAxis(const World &w, unsigned layerNum, Coord loc, Dir dir)
 {
     // Converts the signal density along the specified axis to sensor range. The
     // values of cell signal levels are scaled by the inverse of their distance times
@@ -119,6 +125,11 @@ float getSignalDensityAlongAxis(unsigned layerNum, Coord loc, Dir dir)
 
     assert(dir != Compass_CENTER); // require a defined axis
 
+    const Params &p = *w.params;
+    if (!w.signals.anyActive(layerNum, loc, p.signalSensorRadius)) {
+        return 0.5; // the whole neighborhood is in cold tiles
+    }
+
     double sum = 0.0;
     Coord dirVec = dir.asNormalizedCoord();
     double len = std::sqrt(dirVec.x * dirVec.x + dirVec.y * dirVec.y);
@@ -129,7 +140,7 @@ float getSignalDensityAlongAxis(unsigned layerNum, Coord loc, Dir dir)
         if (tloc != loc) {
             Coord offset = tloc - loc;
             double proj = (dirVecX * offset.x + dirVecY * offset.y); // Magnitude of projection along dir
-            double contrib = (proj * signals.getMagnitude(layerNum, loc)) /
+            double contrib = (proj * w.signals.getMagnitude(layerNum, loc)) /
                     (offset.x * offset.x + offset.y * offset.y);
             sum += contrib;
         }
@@ -150,7 +161,7 @@ float getSignalDensityAlongAxis(unsigned layerNum, Coord loc, Dir dir)
 // direction, not including loc. If the probe encounters a boundary or a
 // barrier before reaching the longProbeDist distance, returns longProbeDist.
 // Returns 0..longProbeDist.
-unsigned longProbePopulationFwd(Coord loc, Dir dir, unsigned longProbeDist)
+unsigned longProbePopulationFwd(const Grid &grid, Coord loc, Dir dir, unsigned longProbeDist)
 {
     assert(longProbeDist > 0);
     unsigned count = 0;
@@ -174,7 +185,7 @@ unsigned longProbePopulationFwd(Coord loc, Dir dir, unsigned longProbeDist)
 // If the distance to the border is less than the longProbeDist distance
 // and no barriers are found, returns longProbeDist.
 // Returns 0..longProbeDist.
-unsigned longProbeBarrierFwd(Coord loc, Dir dir, unsigned longProbeDist)
+unsigned longProbeBarrierFwd(const Grid &grid, Coord loc, Dir dir, unsigned longProbeDist)
 {
     assert(longProbeDist > 0);
     unsigned count = 0;
@@ -193,9 +204,11 @@ unsigned longProbeBarrierFwd(Coord loc, Dir dir, unsigned longProbeDist)
 }
 
 
-// Returned sensor values range SENSOR_MIN..SENSOR_MAX
-float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
+// Returned sensor values range SENSOR_MIN..SENSOR_MAX. w is the world the
+// individual lives in.
+float Indiv::getSensor(const World &w, Sensor sensorNum, unsigned simStep) const
 {
+    const Params &p = *w.params;
     float sensorVal = 0.0;
 
     switch (sensorNum) {
@@ -275,7 +288,7 @@ float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
         // Measures the distance to the nearest other individual in the
         // forward direction. If non found, returns the maximum sensor value.
         // Maps the result to the sensor range 0.0..1.0.
-        sensorVal = longProbePopulationFwd(loc, lastMoveDir, longProbeDist) / (float)longProbeDist; // 0..1
+        sensorVal = longProbePopulationFwd(w.grid, loc, lastMoveDir, longProbeDist) / (float)longProbeDist; // 0..1
         break;
     }
     case Sensor::LONGPROBE_BAR_FWD:
@@ -283,7 +296,7 @@ float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
         // Measures the distance to the nearest barrier in the forward
         // direction. If non found, returns the maximum sensor value.
         // Maps the result to the sensor range 0.0..1.0.
-        sensorVal = longProbeBarrierFwd(loc, lastMoveDir, longProbeDist) / (float)longProbeDist; // 0..1
+        sensorVal = longProbeBarrierFwd(w.grid, loc, lastMoveDir, longProbeDist) / (float)longProbeDist; // 0..1
         break;
     }
     case Sensor::POPULATION:
@@ -296,7 +309,7 @@ float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
 
         auto f = [&](Coord tloc) {
             ++countLocs;
-            if (grid.isOccupiedAt(tloc)) {
+            if (w.grid.isOccupiedAt(tloc)) {
                 ++countOccupied;
             }
         };
@@ -308,21 +321,21 @@ float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
     case Sensor::POPULATION_FWD:
         // Sense population density along axis of last movement direction, mapped
         // to sensor range 0.0..1.0
-        sensorVal = getPopulationDensityAlongAxis(loc, lastMoveDir);
+        sensorVal = getPopulationDensityAlongAxis(w, loc, lastMoveDir);
         break;
     case Sensor::POPULATION_LR:
         // Sense population density along an axis 90 degrees from last movement direction
-        sensorVal = getPopulationDensityAlongAxis(loc, lastMoveDir.rotate90DegCW());
+        sensorVal = getPopulationDensityAlongAxis(w, loc, lastMoveDir.rotate90DegCW());
         break;
     case Sensor::BARRIER_FWD:
         // Sense the nearest barrier along axis of last movement direction, mapped
         // to sensor range 0.0..1.0
-        sensorVal = getShortProbeBarrierDistance(loc, lastMoveDir, p.shortProbeBarrierDistance);
+        sensorVal = getShortProbeBarrierDistance(w.grid, loc, lastMoveDir, p.shortProbeBarrierDistance);
         break;
     case Sensor::BARRIER_LR:
         // Sense the nearest barrier along axis perpendicular to last movement direction, mapped
         // to sensor range 0.0..1.0
-        sensorVal = getShortProbeBarrierDistance(loc, lastMoveDir.rotate90DegCW(), p.shortProbeBarrierDistance);
+        sensorVal = getShortProbeBarrierDistance(w.grid, loc, lastMoveDir.rotate90DegCW(), p.shortProbeBarrierDistance);
         break;
     case Sensor::RANDOM:
         // Returns a random sensor value in the range 0.0..1.0.
@@ -331,25 +344,25 @@ float Indiv::getSensor(Sensor sensorNum, unsigned simStep) const
     case Sensor::SIGNAL0:
         // Returns magnitude of signal0 in the local neighborhood, with
         // 0.0..maxSignalSum converted to sensorRange 0.0..1.0
-        sensorVal = getSignalDensity(0, loc);
+        sensorVal = getSignalDensity(w, 0, loc);
         break;
     case Sensor::SIGNAL0_FWD:
         // Sense signal0 density along axis of last movement direction
-        sensorVal = getSignalDensityAlongAxis(0, loc, lastMoveDir);
+        sensorVal = getSignalDensityAlongAxis(w, 0, loc, lastMoveDir);
         break;
     case Sensor::SIGNAL0_LR:
         // Sense signal0 density along an axis perpendicular to last movement direction
-        sensorVal = getSignalDensityAlongAxis(0, loc, lastMoveDir.rotate90DegCW());
+        sensorVal = getSignalDensityAlongAxis(w, 0, loc, lastMoveDir.rotate90DegCW());
         break;
     case Sensor::GENETIC_SIM_FWD:
     {
         // Return minimum sensor value if nobody is alive in the forward adjacent location,
         // else returns a similarity match in the sensor range 0.0..1.0
         Coord loc2 = loc + lastMoveDir;
-        if (grid.isInBounds(loc2) && grid.isOccupiedAt(loc2)) {
-            const Indiv &indiv2 = peeps.getIndiv(loc2);
+        if (w.grid.isInBounds(loc2) && w.grid.isOccupiedAt(loc2)) {
+            const Indiv &indiv2 = w.peeps.getIndiv(w.grid, loc2);
             if (indiv2.alive) {
-                sensorVal = genomeSimilarity(genome, indiv2.genome); // 0.0..1.0
+                sensorVal = genomeSimilarity(fingerprint, genome, indiv2.fingerprint, indiv2.genome); // 0.0..1.0
             }
         }
         break;
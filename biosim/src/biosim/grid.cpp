@@ -1,7 +1,9 @@
 // grid.cpp
 
+#include <iostream>
 #include <functional>
 #include <cassert>
+#include <utility>
 #include "simulator.h"
 
 namespace BS {
@@ -11,21 +13,49 @@ void Grid::init(uint16_t sizeX, uint16_t sizeY)
 {
     auto col = Column(sizeY);
     data = std::vector<Column>(sizeX, col);
+    emptyLocations.clear();
+    full = false;
 }
 
 
-// Finds a random unoccupied location in the grid
-Coord Grid::findEmptyLocation() const {
-    Coord loc;
-
-    while (true) {
-        loc.x = randomUint(0, p.sizeX - 1);
-        loc.y = randomUint(0, p.sizeY - 1);
-        if (grid.isEmptyAt(loc)) {
+// Finds a random unoccupied location in the grid. Rejection sampling slows
+// to a crawl when the world is crowded, so instead we draw from a lazy
+// Fisher-Yates shuffle of all the locations that were empty when the index
+// was built: each call swaps one random remaining candidate to the front
+// and takes it, which is O(1) regardless of occupancy. The index is built
+// on the first call after zeroFill(), i.e., after the barriers are in place
+// at the start of a generation. Candidates that have been occupied since
+// the index was built are skipped, and when they run out the index is
+// rebuilt from the grid as it is now, which picks up locations emptied
+// since (deaths, movement). Returns false if no location is empty; a grid
+// found full is not scanned again until a location is emptied.
+bool Grid::findEmptyLocation(Coord &loc)
+{
+    for (bool rebuilt = false; !full; rebuilt = true) {
+        while (emptyLocationsTaken < emptyLocations.size()) {
+            size_t pick = randomUint(emptyLocationsTaken, emptyLocations.size() - 1);
+            std::swap(emptyLocations[emptyLocationsTaken], emptyLocations[pick]);
+            loc = emptyLocations[emptyLocationsTaken++];
+            if (isEmptyAt(loc)) {
+                return true;
+            }
+        }
+        if (rebuilt) {
+            full = true;
             break;
         }
+
+        emptyLocations.clear();
+        for (int16_t x = 0; x < sizeX(); ++x) {
+            for (int16_t y = 0; y < sizeY(); ++y) {
+                if (data[x][y] == EMPTY) {
+                    emptyLocations.push_back( { x, y } );
+                }
+            }
+        }
+        emptyLocationsTaken = 0;
     }
-    return loc;
+    return false;
 }
 
 
@@ -34,13 +64,17 @@ Coord Grid::findEmptyLocation() const {
 // neighborhood to the specified function. Locations include self (center of the neighborhood).
 void visitNeighborhood(Coord loc, float radius, std::function<void(Coord)> f)
 {
-    for (int dx = -std::min<int>(radius, loc.x); dx <= std::min<int>(radius, (p.sizeX - loc.x) - 1); ++dx) {
+    const Params &p = *world->params;
+    // Read the bounds once rather than on every pass
+    const int sizeX = p.sizeX;
+    const int sizeY = p.sizeY;
+    for (int dx = -std::min<int>(radius, loc.x); dx <= std::min<int>(radius, (sizeX - loc.x) - 1); ++dx) {
         int16_t x = loc.x + dx;
-        assert(x >= 0 && x < p.sizeX);
+        assert(x >= 0 && x < sizeX);
         int extentY = (int)sqrt(radius * radius - dx * dx);
-        for (int dy = -std::min<int>(extentY, loc.y); dy <= std::min<int>(extentY, (p.sizeY - loc.y) - 1); ++dy) {
+        for (int dy = -std::min<int>(extentY, loc.y); dy <= std::min<int>(extentY, (sizeY - loc.y) - 1); ++dy) {
             int16_t y = loc.y + dy;
-            assert(y >= 0 && y < p.sizeY);
+            assert(y >= 0 && y < sizeY);
             f( Coord { x, y} );
         }
     }
@@ -21,6 +21,7 @@ namespace BS {
 //
 void saveOneFrameImmed(const ImageFrameData &data)
 {
+    const Params &p = *world->params;
     //using namespace cimg_library;
 
     // CImg<uint8_t> image(p.sizeX * p.displayScale, p.sizeY * p.displayScale,
@@ -124,6 +125,7 @@ uint8_t makeGeneticColor(const Genome &genome)
 // there's a job to do.
 bool ImageWriter::saveVideoFrame(unsigned simStep, unsigned generation)
 {
+    const Params &p = *world->params;
     if (!busy) {
         busy = true;
         std::lock_guard<std::mutex> lck(mutex_);
@@ -138,6 +140,7 @@ bool ImageWriter::saveVideoFrame(unsigned simStep, unsigned generation)
         data.barrierLocs.clear();
         data.signalLayers.clear();
         //todo!!!
+        const Peeps &peeps = world->peeps;
         for (uint16_t index = 1; index <= p.population; ++index) {
             const Indiv &indiv = peeps[index];
             if (indiv.alive) {
@@ -146,7 +149,7 @@ bool ImageWriter::saveVideoFrame(unsigned simStep, unsigned generation)
             }
         }
 
-        auto const &barrierLocs = grid.getBarrierLocations();
+        auto const &barrierLocs = world->grid.getBarrierLocations();
         for (Coord loc : barrierLocs) {
             data.barrierLocs.push_back(loc);
         }
@@ -168,6 +171,7 @@ bool ImageWriter::saveVideoFrame(unsigned simStep, unsigned generation)
 // Synchronous version, always returns true
 bool ImageWriter::saveVideoFrameSync(unsigned simStep, unsigned generation)
 {
+    const Params &p = *world->params;
     // We cache a local copy of data from params, grid, and peeps because
     // those objects will change by the main thread at the same time our
     // saveFrameThread() is using it to output a video frame.
@@ -180,6 +184,7 @@ bool ImageWriter::saveVideoFrameSync(unsigned simStep, unsigned generation)
     data.barrierLocs.clear();
     data.signalLayers.clear();
     //todo!!!
+    const Peeps &peeps = world->peeps;
     for (uint16_t index = 1; index <= p.population; ++index) {
         const Indiv &indiv = peeps[index];
         if (indiv.alive) {
@@ -188,7 +193,7 @@ bool ImageWriter::saveVideoFrameSync(unsigned simStep, unsigned generation)
         }
     }
 
-    auto const &barrierLocs = grid.getBarrierLocations();
+    auto const &barrierLocs = world->grid.getBarrierLocations();
     for (Coord loc : barrierLocs) {
         data.barrierLocs.push_back(loc);
     }
@@ -10,12 +10,28 @@ namespace BS {
 // The responsiveness parameter will be initialized here to maximum value
 // of 1.0, then depending on which action activation function is used,
 // the default undriven value may be changed to 1.0 or action midrange.
-void Indiv::initialize(uint16_t index_, Coord loc_, Genome &&genome_)
+void Indiv::initialize(uint16_t index_, Grid &grid, Coord loc_, Genome &&genome_)
 {
+    initialize(index_, std::move(genome_));
+    place(grid, loc_);
+}
+
+
+void Indiv::initialize(uint16_t index_, Genome &&genome_)
+{
+    genome = std::move(genome_);
+    initialize(index_);
+}
+
+
+// Builds the genome-derived state without touching the grid, so this may
+// run on worker threads for different individuals at the same time. It
+// draws from the calling thread's randomUint. If wired is true, .nnet
+// already holds the wiring for .genome (see WiringArena) and is kept.
+void Indiv::initialize(uint16_t index_, bool wired)
+{
+    const Params &p = *world->params;
     index = index_;
-    loc = loc_;
-    birthLoc = loc_;
-    grid.set(loc_, index_);
     age = 0;
     oscPeriod = 34; // ToDo !!! define a constant
     alive = true;
@@ -23,8 +39,20 @@ void Indiv::initialize(uint16_t index_, Coord loc_, Genome &&genome_)
     responsiveness = 0.5; // range 0.0..1.0
     longProbeDist = p.longProbeDistance;
     challengeBits = (unsigned)false; // will be set true when some task gets accomplished
-    genome = std::move(genome_);
-    createWiringFromGenome();
+    fingerprint = genomeFingerprint(genome);
+    genomeSketch(genome, sketch);
+    if (!wired) {
+        createWiringFromGenome();
+    }
+}
+
+
+// Must be called in single-thread mode
+void Indiv::place(Grid &grid, Coord loc_)
+{
+    loc = loc_;
+    birthLoc = loc_;
+    grid.set(loc_, index);
 }
 
 } // end namespace BS
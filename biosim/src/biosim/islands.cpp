@@ -0,0 +1,207 @@
+// islands.cpp -- island-model evolution
+
+// If p.numIslands > 1, that many worlds evolve side by side: mainWorld,
+// stepped by the sim thread as usual, plus p.numIslands - 1 islands, each
+// stepped by a thread of its own with its own grid, signals, population,
+// lineage, and random number stream. The islands follow the sim thread's
+// runMode but otherwise keep their own generation counts. Each island also
+// has a ParamManager of its own, copied from the main one when the islands
+// start and refreshed from the config file at the island's own generation
+// boundaries, so name@generation values take effect by its own count.
+//
+// Every p.islandMigrationInterval generations, each world sends copies of
+// its p.islandMigrants best-scoring parents to the next world in a ring,
+// then adds whatever its predecessor last sent to its own parents. Each
+// world has a mailbox holding a pointer to the latest batch sent to it;
+// sending and collecting are one atomic exchange each, so the worlds never
+// wait on each other. A batch that is not collected before the next one
+// arrives is dropped. Because the worlds run at their own speeds, which
+// batch a world collects is not reproducible from run to run.
+//
+// Only mainWorld is shown, saved in videos, logs, and archives, and saved
+// in checkpoints.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+extern void initializeGeneration0();
+extern unsigned spawnNewGeneration(unsigned generation, unsigned murderCount);
+extern void simStepOneIndiv(World &w, Indiv &indiv, unsigned simStep);
+extern void endOfSimStep(unsigned simStep, unsigned generation);
+extern void endOfGeneration(unsigned generation);
+
+namespace {
+
+struct Migrants {
+    std::vector<Genome> genomes;
+};
+
+// One mailbox per world, indexed by World::islandNum; empty if the islands
+// were never started
+std::unique_ptr<std::atomic<Migrants *>[]> mailboxes;
+unsigned numMailboxes = 0;
+
+struct Island {
+    World world;
+    ParamManager params;
+};
+
+std::vector<std::unique_ptr<Island>> islands;
+std::vector<std::thread> islandThreads;
+std::atomic<bool> stopRequested { false };
+
+}
+
+
+// Steps one island until p.maxGenerations or until stopIslands()
+static void runIsland(Island *island)
+{
+    World &w = island->world;
+    world = &w;
+    const Params &p = *w.params;
+    randomUint.initialize();
+    randomUint.initialize(randomUint(), w.islandNum);
+
+    Peeps &peeps = w.peeps;
+    w.grid.init(p.sizeX, p.sizeY);
+    w.signals.init(p.signalLayers, p.sizeX, p.sizeY, p.lazySignalFade, p.numThreads);
+    peeps.init(p.population);
+    initializeGeneration0();
+
+    unsigned generation = 0;
+    while (generation < p.maxGenerations && !stopRequested) {
+        if (runMode == RunMode::STOP || runMode == RunMode::ABORT) {
+            break;
+        }
+        if (runMode != RunMode::RUN) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        unsigned murderCount = 0;
+        for (unsigned simStep = 0; simStep < p.stepsPerGeneration; ++simStep) {
+            for (unsigned indivIndex = 1; indivIndex <= p.population; ++indivIndex) {
+                if (peeps[indivIndex].alive) {
+                    simStepOneIndiv(w, peeps[indivIndex], simStep);
+                }
+            }
+            murderCount += peeps.deathQueueSize();
+            endOfSimStep(simStep, generation);
+        }
+        endOfGeneration(generation);
+
+        island->params.updateFromConfigFile(generation + 1);
+        unsigned numberSurvivors = spawnNewGeneration(generation, murderCount);
+        generation = (numberSurvivors == 0) ? 0 : generation + 1;
+    }
+}
+
+
+// Call from the thread that initialized mainWorld before the sim thread
+// starts, or from the sim thread between generations after stopIslands(),
+// as when a checkpoint is restored. Migrants still waiting in the
+// mailboxes are dropped.
+void startIslands()
+{
+    const Params &p = *world->params;
+    if (p.numIslands < 2 || !islands.empty()) {
+        return;
+    }
+
+    if (mailboxes) {
+        for (unsigned n = 0; n < numMailboxes; ++n) {
+            delete mailboxes[n].exchange(nullptr);
+        }
+    }
+    if (numMailboxes != p.numIslands) {
+        numMailboxes = p.numIslands;
+        mailboxes.reset(new std::atomic<Migrants *>[numMailboxes]);
+        for (unsigned n = 0; n < numMailboxes; ++n) {
+            mailboxes[n].store(nullptr);
+        }
+    }
+
+    for (unsigned islandNum = 1; islandNum < p.numIslands; ++islandNum) {
+        islands.emplace_back(new Island());
+        Island &island = *islands.back();
+        island.params = paramManager;
+        island.world.params = &island.params.getParamRef();
+        island.world.islandNum = islandNum;
+        island.world.primary = false;
+    }
+    for (std::unique_ptr<Island> &island : islands) {
+        islandThreads.emplace_back(runIsland, island.get());
+    }
+    std::cout << "Started " << islands.size() << " islands" << std::endl;
+}
+
+
+// Stops the island threads and waits for them. The mailboxes are left in
+// place because the sim thread may still be using them.
+void stopIslands()
+{
+    stopRequested = true;
+    for (std::thread &thread : islandThreads) {
+        thread.join();
+    }
+    islandThreads.clear();
+    islands.clear();
+    stopRequested = false;
+}
+
+
+// On migration generations, sends the best of the calling world's parents
+// to the next world and appends the genomes received from the previous one
+// to parentGenomes, with parent id 0 (their ancestry is on another island)
+// and the mean weight of the local parents. parents must still refer to
+// the individuals in peeps[].
+bool exchangeMigrants(unsigned generation, const std::vector<std::pair<uint16_t, float>> &parents,
+                      GenomeArena &parentGenomes, std::vector<uint64_t> &parentIds,
+                      std::vector<float> &parentWeights)
+{
+    const Params &p = *world->params;
+    if (!mailboxes || p.numIslands < 2 || generation == 0 || generation % p.islandMigrationInterval != 0) {
+        return false;
+    }
+    const unsigned self = world->islandNum;
+
+    // Send copies of the highest-scoring parents
+    std::vector<std::pair<uint16_t, float>> best(parents);
+    const unsigned numSent = std::min<size_t>(p.islandMigrants, best.size());
+    std::partial_sort(best.begin(), best.begin() + numSent, best.end(),
+        [](const std::pair<uint16_t, float> &a, const std::pair<uint16_t, float> &b) {
+            return a.second > b.second;
+        });
+    if (numSent > 0) {
+        std::unique_ptr<Migrants> batch(new Migrants());
+        for (unsigned n = 0; n < numSent; ++n) {
+            batch->genomes.push_back(world->peeps[best[n].first].genome);
+        }
+        delete mailboxes[(self + 1) % numMailboxes].exchange(batch.release(), std::memory_order_acq_rel);
+    }
+
+    // Take in the latest batch sent here, if any
+    std::unique_ptr<Migrants> received(mailboxes[self].exchange(nullptr, std::memory_order_acq_rel));
+    if (!received || received->genomes.empty()) {
+        return false;
+    }
+    const float weight = parentWeights.empty() ? 1.0f
+        : std::accumulate(parentWeights.begin(), parentWeights.end(), 0.0f) / parentWeights.size();
+    for (const Genome &genome : received->genomes) {
+        parentGenomes.append(genome);
+        parentIds.push_back(0);
+        parentWeights.push_back(weight);
+    }
+    return true;
+}
+
+} // end namespace BS
@@ -0,0 +1,265 @@
+// lineage.cpp -- generation-bucketed store of the primary-parent tree
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include "simulator.h"
+
+namespace BS {
+
+void Lineage::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint64_t nextId = data.nextId;
+    data = Columns();
+    data.nextId = nextId;
+}
+
+
+// Must be called in single-thread mode
+uint64_t Lineage::newIds(unsigned count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint64_t firstId = data.nextId;
+    data.nextId += count;
+    return firstId;
+}
+
+
+size_t Lineage::bucketEnd(size_t bucket) const
+{
+    return bucket + 1 < data.starts.size() ? data.starts[bucket + 1] : data.offsets.size();
+}
+
+
+// Appends the newest generation, peeps[1..population], whose ids must have
+// come from one call to newIds(). The parents of the individuals must be in
+// the previous generation added. Must be called in single-thread mode.
+void Lineage::addGeneration(unsigned generation, const Peeps &peeps, unsigned population)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const uint64_t firstId = peeps[1].id;
+    const size_t previous = data.starts.size() - 1; // SIZE_MAX if none
+    if (data.starts.empty()) {
+        data.firstGeneration = generation;
+    }
+    assert(generation == data.firstGeneration + data.starts.size());
+
+    data.firstIds.push_back(firstId);
+    data.starts.push_back(data.offsets.size());
+    for (uint16_t index = 1; index <= population; ++index) {
+        const Indiv &indiv = peeps[index];
+        assert(indiv.id == firstId + index - 1);
+        data.offsets.push_back(index - 1);
+
+        // The previous bucket is the newest one before this, which prune()
+        // always leaves whole, so a parent's position is its id offset
+        uint16_t parent = NO_PARENT;
+        if (indiv.parentIds[0] != 0 && previous != SIZE_MAX) {
+            const uint64_t offset = indiv.parentIds[0] - data.firstIds[previous];
+            if (offset < bucketEnd(previous) - data.starts[previous]) {
+                parent = offset;
+            }
+        }
+        data.parents.push_back(parent);
+    }
+
+    if (data.offsets.size() > 2 * std::max<size_t>(data.sizeAfterPrune, population)) {
+        prune();
+    }
+}
+
+
+// Keeps only the newest generation and its ancestors. Called with the
+// mutex locked.
+void Lineage::prune()
+{
+    const size_t numBuckets = data.starts.size();
+    if (numBuckets < 2) {
+        return;
+    }
+
+    // Mark the ancestors of the newest generation, newest bucket first
+    std::vector<uint8_t> keep(data.offsets.size(), 0);
+    std::fill(keep.begin() + data.starts[numBuckets - 1], keep.end(), 1);
+    for (size_t bucket = numBuckets - 1; bucket > 0; --bucket) {
+        for (size_t entry = data.starts[bucket]; entry < bucketEnd(bucket); ++entry) {
+            if (keep[entry] && data.parents[entry] != NO_PARENT) {
+                keep[data.starts[bucket - 1] + data.parents[entry]] = 1;
+            }
+        }
+    }
+
+    // Compact the columns oldest bucket first, renumbering the parent
+    // positions as the previous bucket shrinks. Buckets that end up empty
+    // can only be the oldest ones, which are dropped.
+    std::vector<uint16_t> newPosition(data.offsets.size());
+    size_t out = 0;
+    size_t firstKeptBucket = SIZE_MAX;
+    size_t previousBegin = 0;
+    for (size_t bucket = 0; bucket < numBuckets; ++bucket) {
+        const size_t begin = data.starts[bucket];
+        const size_t end = bucketEnd(bucket);
+        data.starts[bucket] = out;
+        uint16_t position = 0;
+        for (size_t entry = begin; entry < end; ++entry) {
+            if (!keep[entry]) {
+                continue;
+            }
+            newPosition[entry] = position++;
+            uint16_t parent = data.parents[entry];
+            if (parent != NO_PARENT) {
+                parent = newPosition[previousBegin + parent];
+            }
+            data.offsets[out] = data.offsets[entry];
+            data.parents[out] = parent;
+            ++out;
+        }
+        if (position > 0 && firstKeptBucket == SIZE_MAX) {
+            firstKeptBucket = bucket;
+        }
+        previousBegin = begin;
+    }
+    data.offsets.resize(out);
+    data.parents.resize(out);
+    data.firstIds.erase(data.firstIds.begin(), data.firstIds.begin() + firstKeptBucket);
+    data.starts.erase(data.starts.begin(), data.starts.begin() + firstKeptBucket);
+    data.firstGeneration += firstKeptBucket;
+    data.sizeAfterPrune = out;
+}
+
+
+// Returns the entry number of id and sets bucket, or returns SIZE_MAX if
+// id is not stored. Called with the mutex locked.
+size_t Lineage::find(uint64_t id, size_t &bucket) const
+{
+    auto after = std::upper_bound(data.firstIds.begin(), data.firstIds.end(), id);
+    if (after == data.firstIds.begin()) {
+        return SIZE_MAX;
+    }
+    bucket = after - data.firstIds.begin() - 1;
+    const uint64_t offset = id - data.firstIds[bucket];
+    if (offset > UINT16_MAX) {
+        return SIZE_MAX;
+    }
+    auto begin = data.offsets.begin() + data.starts[bucket];
+    auto end = data.offsets.begin() + bucketEnd(bucket);
+    auto found = std::lower_bound(begin, end, (uint16_t)offset);
+    if (found == end || *found != offset) {
+        return SIZE_MAX;
+    }
+    return found - data.offsets.begin();
+}
+
+
+// Returns the id of the newest individual that is a primary-parent ancestor
+// of both, where an individual counts as its own ancestor. Returns 0 if
+// either one has been pruned or they have no common ancestor on record.
+uint64_t Lineage::mostRecentCommonAncestor(uint64_t id1, uint64_t id2) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t bucket1;
+    size_t bucket2;
+    size_t entry1 = find(id1, bucket1);
+    size_t entry2 = find(id2, bucket2);
+    if (entry1 == SIZE_MAX || entry2 == SIZE_MAX) {
+        return 0;
+    }
+
+    // Step the newer one back to the older one's generation, then both
+    // together until they meet
+    auto stepBack = [this](size_t &entry, size_t &bucket) {
+        const uint16_t parent = data.parents[entry];
+        if (parent == NO_PARENT) {
+            return false;
+        }
+        --bucket;
+        entry = data.starts[bucket] + parent;
+        return true;
+    };
+    while (bucket1 > bucket2) {
+        if (!stepBack(entry1, bucket1)) {
+            return 0;
+        }
+    }
+    while (bucket2 > bucket1) {
+        if (!stepBack(entry2, bucket2)) {
+            return 0;
+        }
+    }
+    while (entry1 != entry2) {
+        if (!stepBack(entry1, bucket1) || !stepBack(entry2, bucket2)) {
+            return 0;
+        }
+    }
+    return data.firstIds[bucket1] + data.offsets[entry1];
+}
+
+
+// Returns the number of individuals in the newest generation that descend
+// from id through primary parents, counting id itself if it is in the
+// newest generation
+unsigned Lineage::numDescendants(uint64_t id) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t bucket;
+    size_t entry = find(id, bucket);
+    if (entry == SIZE_MAX) {
+        return 0;
+    }
+
+    // Sweep forward one generation at a time, flagging the entries whose
+    // parent is flagged
+    std::vector<uint8_t> isDescendant(bucketEnd(bucket) - data.starts[bucket], 0);
+    isDescendant[entry - data.starts[bucket]] = 1;
+    std::vector<uint8_t> next;
+    for (++bucket; bucket < data.starts.size(); ++bucket) {
+        next.assign(bucketEnd(bucket) - data.starts[bucket], 0);
+        bool any = false;
+        for (size_t position = 0; position < next.size(); ++position) {
+            const uint16_t parent = data.parents[data.starts[bucket] + position];
+            if (parent != NO_PARENT && isDescendant[parent]) {
+                next[position] = 1;
+                any = true;
+            }
+        }
+        if (!any) {
+            return 0;
+        }
+        isDescendant.swap(next);
+    }
+    return std::count(isDescendant.begin(), isDescendant.end(), 1);
+}
+
+
+size_t Lineage::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return data.offsets.size();
+}
+
+
+unsigned Lineage::numGenerations() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return data.starts.size();
+}
+
+
+Lineage::Columns Lineage::getColumns() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return data;
+}
+
+
+void Lineage::setColumns(Columns &&columns)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    data = std::move(columns);
+}
+
+} // end namespace BS
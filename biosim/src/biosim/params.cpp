@@ -36,7 +36,15 @@ void ParamManager::setDefaults()
     privParams.maxGenerations = 200000;
     privParams.barrierType = 0;
     privParams.numThreads = 4;
+    privParams.numIslands = 1;
+    privParams.islandMigrationInterval = 10;
+    privParams.islandMigrants = 5;
     privParams.signalLayers = 1;
+    privParams.lazySignalFade = false;
+    privParams.signalDiffusion = 0;
+    privParams.signalDiffusionCenter = 128;
+    privParams.signalDiffusionEdge = 24;
+    privParams.signalDiffusionCorner = 8;
     privParams.maxNumberNeurons = 5;
     privParams.pointMutationRate = 0.001;
     privParams.geneInsertionDeletionRate = 0.0;
@@ -44,6 +52,7 @@ void ParamManager::setDefaults()
     privParams.killEnable = false;
     privParams.sexualReproduction = true;
     privParams.chooseParentsByFitness = true;
+    privParams.selectionPressure = 1.0;
     privParams.populationSensorRadius = 2.5;
     privParams.signalSensorRadius = 2.0;
     privParams.responsiveness = 0.5;
@@ -58,7 +67,12 @@ void ParamManager::setDefaults()
     privParams.agentSize = 4;
     privParams.genomeAnalysisStride = privParams.videoStride;
     privParams.displaySampleGenomes = 5;
+    privParams.epochLogBinary = false;
+    privParams.genomeArchive = false;
+    privParams.genomeArchiveKeyframeStride = 50;
     privParams.genomeComparisonMethod = 1;
+    privParams.speciesClustering = true;
+    privParams.speciesSimilarity = 0.5;
     privParams.updateGraphLog = true;
     privParams.updateGraphLogStride = privParams.videoStride;
     privParams.deterministic = false;
@@ -118,7 +132,7 @@ bool getBoolVal(const std::string &s)
 }
 
 
-void ParamManager::ingestParameter(std::string name, std::string val)
+bool ParamManager::ingestParameter(std::string name, std::string val)
 {
     std::transform(name.begin(), name.end(), name.begin(),
                    [](unsigned char c){ return std::tolower(c); });
@@ -168,9 +182,33 @@ void ParamManager::ingestParameter(std::string name, std::string val)
         else if (name == "numthreads" && isUint && uVal > 0 && uVal < (uint16_t)-1) {
             privParams.numThreads = uVal; break;
         }
+        else if (name == "numislands" && isUint && uVal > 0 && uVal <= 256) {
+            privParams.numIslands = uVal; break;
+        }
+        else if (name == "islandmigrationinterval" && isUint && uVal > 0) {
+            privParams.islandMigrationInterval = uVal; break;
+        }
+        else if (name == "islandmigrants" && isUint) {
+            privParams.islandMigrants = uVal; break;
+        }
         else if (name == "signallayers" && isUint && uVal < (uint16_t)-1) {
             privParams.signalLayers = uVal; break;
         }
+        else if (name == "lazysignalfade" && isBool) {
+            privParams.lazySignalFade = bVal; break;
+        }
+        else if (name == "signaldiffusion" && isUint && (uVal == 0 || uVal == 5 || uVal == 9)) {
+            privParams.signalDiffusion = uVal; break;
+        }
+        else if (name == "signaldiffusioncenter" && isUint && uVal <= 256) {
+            privParams.signalDiffusionCenter = uVal; break;
+        }
+        else if (name == "signaldiffusionedge" && isUint && uVal <= 64) {
+            privParams.signalDiffusionEdge = uVal; break;
+        }
+        else if (name == "signaldiffusioncorner" && isUint && uVal <= 64) {
+            privParams.signalDiffusionCorner = uVal; break;
+        }
         else if (name == "genomemaxlength" && isUint && uVal > 0 && uVal < (uint16_t)-1) {
             privParams.genomeMaxLength = uVal; break;
         }
@@ -195,6 +233,9 @@ void ParamManager::ingestParameter(std::string name, std::string val)
         else if (name == "chooseparentsbyfitness" && isBool) {
             privParams.chooseParentsByFitness = bVal; break;
         }
+        else if (name == "selectionpressure" && isFloat && dVal >= 0.0) {
+            privParams.selectionPressure = dVal; break;
+        }
         else if (name == "populationsensorradius" && isFloat && dVal > 0.0) {
             privParams.populationSensorRadius = dVal; break;
         }
@@ -240,9 +281,24 @@ void ParamManager::ingestParameter(std::string name, std::string val)
         else if (name == "displaysamplegenomes" && isUint) {
             privParams.displaySampleGenomes = uVal; break;
         }
+        else if (name == "epochlogbinary" && isBool) {
+            privParams.epochLogBinary = bVal; break;
+        }
+        else if (name == "genomearchive" && isBool) {
+            privParams.genomeArchive = bVal; break;
+        }
+        else if (name == "genomearchivekeyframestride" && isUint && uVal > 0) {
+            privParams.genomeArchiveKeyframeStride = uVal; break;
+        }
         else if (name == "genomecomparisonmethod" && isUint) {
             privParams.genomeComparisonMethod = uVal; break;
         }
+        else if (name == "speciesclustering" && isBool) {
+            privParams.speciesClustering = bVal; break;
+        }
+        else if (name == "speciessimilarity" && isFloat && dVal >= 0.0 && dVal <= 1.0) {
+            privParams.speciesSimilarity = dVal; break;
+        }
         else if (name == "updategraphlog" && isBool) {
             privParams.updateGraphLog = bVal; break;
         }
@@ -260,13 +316,16 @@ void ParamManager::ingestParameter(std::string name, std::string val)
         }
         else {
             std::cout << "Invalid param: " << name << " = " << val << std::endl;
+            return false;
         }
     } while (0);
+    return true;
 }
 
 
 void ParamManager::updateFromConfigFile(unsigned generationNumber)
 {
+    const Params previous = privParams;
     // std::ifstream is RAII, i.e. no need to call close
     std::ifstream cFile(configFilename.c_str());
     if (cFile.is_open()) {
@@ -315,6 +374,34 @@ void ParamManager::updateFromConfigFile(unsigned generationNumber)
     else {
         std::cerr << "Couldn't open config file " << configFilename << ".\n" << std::endl;
     }
+
+    // The grid, signals, and peeps were sized from the restored checkpoint,
+    // so the config file cannot change the parameters they were sized from
+    if (sizesRestored) {
+        if (!sizesWarned && (privParams.population != previous.population
+                || privParams.sizeX != previous.sizeX || privParams.sizeY != previous.sizeY
+                || privParams.signalLayers != previous.signalLayers
+                || privParams.lazySignalFade != previous.lazySignalFade
+                || privParams.numThreads != previous.numThreads)) {
+            std::cerr << "Config file sizes ignored; keeping those of the restored checkpoint" << std::endl;
+            sizesWarned = true;
+        }
+        privParams.population = previous.population;
+        privParams.sizeX = previous.sizeX;
+        privParams.sizeY = previous.sizeY;
+        privParams.signalLayers = previous.signalLayers;
+        privParams.lazySignalFade = previous.lazySignalFade;
+        privParams.numThreads = previous.numThreads;
+    }
+}
+
+
+// Replaces all the parameters with those saved in a checkpoint. The sizes
+// among them then stay put, see updateFromConfigFile().
+void ParamManager::restore(const Params &params)
+{
+    privParams = params;
+    sizesRestored = true;
 }
 
 
@@ -325,6 +412,13 @@ void ParamManager::checkParameters()
     if (privParams.deterministic && privParams.numThreads != 1) {
         std::cerr << "Warning: When deterministic is true, you probably want to set numThreads = 1." << std::endl;
     }
+    if (privParams.signalDiffusion != 0 && privParams.lazySignalFade) {
+        std::cerr << "Warning: signalDiffusion has no effect when lazySignalFade is true." << std::endl;
+    }
+    if (privParams.signalDiffusion != 0 && privParams.signalDiffusionCenter + 4 * privParams.signalDiffusionEdge
+            + (privParams.signalDiffusion == 9 ? 4 * privParams.signalDiffusionCorner : 0) > 256) {
+        std::cerr << "Warning: signal diffusion weights add up to more than 256; diffusion is disabled." << std::endl;
+    }
 }
 
 
@@ -40,11 +40,15 @@ void Peeps::queueForDeath(const Indiv &indiv)
 
 
 // Called in single-thread mode at end of sim step. This executes all the
-// queued deaths, removing the dead agents from the grid.
-void Peeps::drainDeathQueue()
+// queued deaths, removing the dead agents from the grid and from the
+// totals over the living.
+void Peeps::drainDeathQueue(Grid &grid, PopulationStats &livingStats)
 {
     for (uint16_t index : deathQueue) {
-        Indiv & indiv = peeps[index];
+        Indiv & indiv = individuals[index];
+        if (indiv.alive) {
+            livingStats.remove(indiv);
+        }
         grid.set(indiv.loc, 0);
         indiv.alive = false;
     }
@@ -74,10 +78,10 @@ void Peeps::queueForMove(const Indiv &indiv, Coord newLoc)
 // but this function can move an individual any arbitrary distance. It is
 // possible that an agent queued for movement was recently killed when the
 // death queue was drained, so we'll ignore already-dead agents.
-void Peeps::drainMoveQueue()
+void Peeps::drainMoveQueue(Grid &grid)
 {
     for (auto& moveRecord : moveQueue) {
-        auto & indiv = peeps[moveRecord.first];
+        auto & indiv = individuals[moveRecord.first];
         if (indiv.alive) {
             Coord newLoc = moveRecord.second;
             Dir moveDir = (newLoc - indiv.loc).asDir();
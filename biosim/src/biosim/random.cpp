@@ -2,7 +2,7 @@
 
 // This file provides a random number generator (RNG) for the main thread
 // and child threads. The global-scoped RNG instance named randomUint is declared
-// "threadprivate" for OpenMP, meaning that each thread will instantiate its
+// thread_local, meaning that each thread will instantiate its
 // own private instance. A side effect is that the object cannot have a
 // non-trivial ctor, so it has an initialize() member function that must be
 // called to seed the RNG instance, typically in simulator() in simulator.cpp
@@ -28,6 +28,7 @@ namespace BS {
 // which algorithm is actually used.
 void RandomUintGenerator::initialize()
 {
+    const Params &p = *world->params;
     if (p.deterministic) {
         // Initialize Marsaglia. Overflow wrap-around is ok. We just want
         // the four parameters to be unrelated. In the extremely unlikely
@@ -73,6 +74,34 @@ void RandomUintGenerator::initialize()
 }
 
 
+// Seeds the RNG with a stream that depends only on (seed, stream), e.g.,
+// a per-generation seed and a child index. This lets work be split among
+// threads in any way without changing the numbers each item draws. The
+// key is scrambled with the splitmix64 finalizer so that neighboring
+// stream numbers start far apart, then the Jenkins state is warmed up.
+void RandomUintGenerator::initialize(uint32_t seed, uint32_t stream)
+{
+    uint64_t z = ((uint64_t)seed << 32 | stream) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+
+    rngx = (uint32_t)z != 0 ? (uint32_t)z : 123456789;
+    rngy = (uint32_t)(z >> 32) != 0 ? (uint32_t)(z >> 32) : 362436000;
+    rngz = rngx ^ 521288629;
+    rngc = rngy ^ 7654321;
+
+    a = 0xf1ea5eed;
+    b = c = d = (uint32_t)(z ^ (z >> 32));
+    if (b == 0) {
+        b = c = d = 123456789;
+    }
+    for (unsigned i = 0; i < 20; ++i) {
+        (*this)();
+    }
+}
+
+
 // This returns a random 32-bit integer. Neither the Marsaglia nor the Jenkins
 // algorithms are of cryptographic quality, but we don't need that. We just need
 // randomness of shotgun quality. The Jenkins algorithm is the fastest.
@@ -104,6 +133,62 @@ uint32_t RandomUintGenerator::operator()()
 }
 
 
+// Vose's construction: each weight is scaled so the average is 1.0, then
+// every column is filled by pairing one under-full entry with one over-full
+// entry, which donates the remainder of the column. Entries left over at
+// the end are full (up to rounding) and keep their own index.
+void AliasTable::build(const std::vector<float> &weights)
+{
+    const size_t n = weights.size();
+    probability.assign(n, 1.0f);
+    alias.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        alias[i] = i;
+    }
+
+    double sum = 0.0;
+    for (float weight : weights) {
+        assert(weight >= 0.0f);
+        sum += weight;
+    }
+    if (n == 0 || sum <= 0.0) {
+        return; // uniform
+    }
+
+    scaled.resize(n);
+    small.clear();
+    large.clear();
+    for (size_t i = 0; i < n; ++i) {
+        scaled[i] = weights[i] * n / sum;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back();
+        small.pop_back();
+        uint32_t more = large.back();
+        probability[less] = scaled[less];
+        alias[less] = more;
+        scaled[more] -= 1.0 - scaled[less];
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+}
+
+
+unsigned AliasTable::sample() const
+{
+    assert(!probability.empty());
+    unsigned column = ((uint64_t)randomUint() * probability.size()) >> 32;
+    if (randomUint() / (float)RANDOM_UINT_MAX < probability[column]) {
+        return column;
+    }
+    return alias[column];
+}
+
+
 // Returns an unsigned integer between min and max, inclusive.
 // Sure, there's a bias when using modulus operator where (max - min) is not
 // a power of two, but we don't care if we generate one value a little more
@@ -121,7 +206,6 @@ unsigned RandomUintGenerator::operator()(unsigned min, unsigned max)
 
 // This is the globally-accessible random number generator. Declaring
 // it threadprivate causes each thread to instantiate a private instance.
-RandomUintGenerator randomUint;
-//#pragma omp threadprivate(randomUint)
+thread_local RandomUintGenerator randomUint;
 
 } // end namespace BS
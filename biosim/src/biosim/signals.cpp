@@ -2,59 +2,476 @@
 // Manages layers of pheremones
 
 #include <cstdint>
+#include <cassert>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 #include "simulator.h"
 
 namespace BS {
 
-void Signals::init(uint16_t numLayers, uint16_t sizeX, uint16_t sizeY)
+void Signals::init(uint16_t numLayers, uint16_t sizeX_, uint16_t sizeY_, bool lazyFade, unsigned numThreads)
 {
-    data = std::vector<Layer>(numLayers, Layer(sizeX, sizeY));
+    sizeX = sizeX_;
+    sizeY = sizeY_;
+    data = std::vector<Layer>(numLayers, Layer(sizeX, sizeY, lazyFade));
+    emitQueues = std::vector<std::vector<Emission>>(std::max(1U, numThreads));
+    emitAmounts.clear();
+    activeTiles = 0;
+}
+
+
+// Calls f(column, firstRow, numRows) for each column segment of the tile
+template <typename F>
+void Signals::Layer::forEachTileColumn(size_t tile, F f)
+{
+    const unsigned x0 = (tile / tilesY) * SIGNAL_TILE_SIZE;
+    const unsigned y0 = (tile % tilesY) * SIGNAL_TILE_SIZE;
+    const unsigned x1 = std::min<unsigned>(numCols, x0 + SIGNAL_TILE_SIZE);
+    const unsigned count = std::min<unsigned>(numRows, y0 + SIGNAL_TILE_SIZE) - y0;
+    for (unsigned x = x0; x < x1; ++x) {
+        f(x, y0, count);
+    }
+}
+
+
+// Zeros only the active tiles; the others already hold zeros. Stale lazy
+// stamps are harmless because a cell is stamped whenever it becomes non-zero.
+void Signals::Layer::zeroFill()
+{
+    for (size_t tile = 0; tile < tiles.size(); ++tile) {
+        if (tiles[tile]) {
+            forEachTileColumn(tile, [this](unsigned x, unsigned y0, unsigned count) {
+                std::fill_n(&data[(size_t)x * numRows + y0], count, 0);
+            });
+            tiles[tile] = 0;
+        }
+    }
+    clock = 0;
+}
+
+
+// Adds amount to a cell, saturating at SIGNAL_MAX. For a lazy layer the
+// pending decay is applied first and the cell is stamped with the current
+// clock, so later reads decay from this point on.
+void Signals::Layer::add(uint16_t x, uint16_t y, unsigned amount)
+{
+    size_t cell = (size_t)x * numRows + y;
+    unsigned value = magnitude(x, y);
+    if (!stamps.empty()) {
+        stamps[cell] = clock;
+    }
+    data[cell] = std::min<unsigned>(SIGNAL_MAX, value + amount);
+    markActive(x, y);
+}
+
+
+// Returns false if every cell within radius of loc is in an inactive tile,
+// in which case all of those cells are known to be zero.
+bool Signals::anyActive(uint16_t layerNum, Coord loc, float radius) const
+{
+    const Layer &layer = data[layerNum];
+    const int r = (int)radius;
+    const uint16_t x0 = std::max(0, loc.x - r) / SIGNAL_TILE_SIZE;
+    const uint16_t x1 = std::min(sizeX - 1, loc.x + r) / SIGNAL_TILE_SIZE;
+    const uint16_t y0 = std::max(0, loc.y - r) / SIGNAL_TILE_SIZE;
+    const uint16_t y1 = std::min(sizeY - 1, loc.y + r) / SIGNAL_TILE_SIZE;
+    for (uint16_t tx = x0; tx <= x1; ++tx) {
+        for (uint16_t ty = y0; ty <= y1; ++ty) {
+            if (layer.tiles[(size_t)tx * layer.tilesY + ty]) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 
 // Increases the specified location by centerIncreaseAmount,
-// and increases the neighboring cells by neighborIncreaseAmount
+// and increases the neighboring cells by neighborIncreaseAmount.
+// Writes the layer immediately; during a sim step use queueForIncrement().
+constexpr uint8_t centerIncreaseAmount = 2;
+constexpr uint8_t neighborIncreaseAmount = 1;
 
-// Is it ok that multiple readers are reading this container while
-// this single thread is writing to it?  todo!!!
 void Signals::increment(uint16_t layerNum, Coord loc)
 {
     constexpr float radius = 1.5;
-    constexpr uint8_t centerIncreaseAmount = 2;
-    constexpr uint8_t neighborIncreaseAmount = 1;
-
-// #pragma omp critical
-    {
-        visitNeighborhood(loc, radius, [layerNum](Coord loc) {
-            if (signals[layerNum][loc.x][loc.y] < SIGNAL_MAX) {
-                signals[layerNum][loc.x][loc.y] =
-                        std::min<unsigned>(SIGNAL_MAX,
-                                           signals[layerNum][loc.x][loc.y] + neighborIncreaseAmount);
+
+    Layer &layer = data[layerNum];
+    visitNeighborhood(loc, radius, [&layer](Coord loc) {
+        layer.add(loc.x, loc.y, neighborIncreaseAmount);
+    });
+
+    layer.add(loc.x, loc.y, centerIncreaseAmount);
+}
+
+
+// Safe to call during multithread mode as long as each thread passes its
+// own threadNum. The emission takes effect at the end of the sim step when
+// drainIncrementQueue() is called.
+void Signals::queueForIncrement(uint16_t layerNum, Coord loc, unsigned threadNum)
+{
+    assert(threadNum < emitQueues.size());
+    emitQueues[threadNum].push_back( { layerNum, loc } );
+}
+
+
+// Saturating add of amounts[i] to each of count cells, sixteen at a time
+// where SIMD is available.
+static void addCells(uint8_t *cells, const uint8_t *amounts, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(cells + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(amounts + i));
+        _mm_storeu_si128((__m128i *)(cells + i), _mm_adds_epu8(v, a));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(cells + i, vqaddq_u8(vld1q_u8(cells + i), vld1q_u8(amounts + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        cells[i] = std::min<unsigned>(SIGNAL_MAX, cells[i] + amounts[i]);
+    }
+}
+
+
+// Called in single-thread mode at end of sim step. Applies all the queued
+// emissions, thread by thread in queue order. All the increments are
+// saturating additions, so the result does not depend on the order. When
+// a layer receives few emissions they are scattered one by one; when it
+// receives many, their 3x3 footprints are first accumulated into a scratch
+// layer which is then added to the signal layer in one vectorized pass.
+void Signals::drainIncrementQueue()
+{
+    for (uint16_t layerNum = 0; layerNum < data.size(); ++layerNum) {
+        Layer &layer = data[layerNum];
+
+        size_t numEmissions = 0;
+        for (const auto &queue : emitQueues) {
+            for (const Emission &emission : queue) {
+                numEmissions += (emission.layerNum == layerNum);
+            }
+        }
+        if (numEmissions == 0) {
+            continue;
+        }
+
+        // Each emission touches nine cells; a full pass costs about one
+        // operation per cell, but much cheaper ones.
+        bool dense = numEmissions * 9 * 8 > layer.numCells();
+
+        if (!dense) {
+            for (const auto &queue : emitQueues) {
+                for (const Emission &emission : queue) {
+                    if (emission.layerNum == layerNum) {
+                        increment(layerNum, emission.loc);
+                    }
+                }
+            }
+            continue;
+        }
+
+        emitAmounts.assign(layer.numCells(), 0);
+        auto accumulate = [this, &layer](int16_t x, int16_t y, unsigned amount) {
+            uint8_t &cell = emitAmounts[(size_t)x * sizeY + y];
+            cell = std::min<unsigned>(SIGNAL_MAX, cell + amount);
+            layer.markActive(x, y);
+        };
+        for (const auto &queue : emitQueues) {
+            for (const Emission &emission : queue) {
+                if (emission.layerNum != layerNum) {
+                    continue;
+                }
+                const Coord loc = emission.loc;
+                for (int16_t x = std::max(0, loc.x - 1); x <= std::min<int>(sizeX - 1, loc.x + 1); ++x) {
+                    for (int16_t y = std::max(0, loc.y - 1); y <= std::min<int>(sizeY - 1, loc.y + 1); ++y) {
+                        accumulate(x, y, neighborIncreaseAmount);
+                    }
+                }
+                accumulate(loc.x, loc.y, centerIncreaseAmount);
             }
-        });
+        }
+
+        if (layer.isLazy()) {
+            for (int16_t x = 0; x < sizeX; ++x) {
+                for (int16_t y = 0; y < sizeY; ++y) {
+                    uint8_t amount = emitAmounts[(size_t)x * sizeY + y];
+                    if (amount != 0) {
+                        layer.add(x, y, amount);
+                    }
+                }
+            }
+        } else {
+            addCells(layer.cells(), emitAmounts.data(), layer.numCells());
+        }
+    }
+
+    for (auto &queue : emitQueues) {
+        queue.clear();
+    }
+}
+
+
+// Saturating subtract of amount from each of count bytes: branch-free and
+// sixteen cells at a time (psubusb on x86, vqsub on ARM), with a scalar
+// loop for the remainder and for other targets. Returns true if any of
+// the cells is still non-zero.
+static bool fadeCells(uint8_t *cells, size_t count, uint8_t amount)
+{
+    size_t i = 0;
+    unsigned remaining = 0;
+#if defined(__SSE2__)
+    const __m128i decrement = _mm_set1_epi8((char)amount);
+    __m128i any = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_subs_epu8(_mm_loadu_si128((const __m128i *)(cells + i)), decrement);
+        _mm_storeu_si128((__m128i *)(cells + i), v);
+        any = _mm_or_si128(any, v);
+    }
+    remaining = _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xffff;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t decrement = vdupq_n_u8(amount);
+    uint8x16_t any = vdupq_n_u8(0);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vqsubq_u8(vld1q_u8(cells + i), decrement);
+        vst1q_u8(cells + i, v);
+        any = vorrq_u8(any, v);
+    }
+    remaining = vget_lane_u64(vreinterpret_u64_u8(vorr_u8(vget_low_u8(any), vget_high_u8(any))), 0) != 0;
+#endif
+    for (; i < count; ++i) {
+        cells[i] = cells[i] > amount ? cells[i] - amount : 0;
+        remaining |= cells[i];
+    }
+    return remaining != 0;
+}
+
 
-        if (signals[layerNum][loc.x][loc.y] < SIGNAL_MAX) {
-            signals[layerNum][loc.x][loc.y] =
-                        std::min<unsigned>(SIGNAL_MAX,
-                                           signals[layerNum][loc.x][loc.y] + centerIncreaseAmount);
+// Fades the active tiles and deactivates the ones that have faded to zero.
+// A lazy layer only advances its clock; the decay is applied when each
+// cell is next read or written, and its tiles stay active until zeroFill().
+void Signals::Layer::fade()
+{
+    if (isLazy()) {
+        advanceClock();
+        return;
+    }
+
+    for (size_t tile = 0; tile < tiles.size(); ++tile) {
+        if (tiles[tile]) {
+            bool remaining = false;
+            forEachTileColumn(tile, [this, &remaining](unsigned x, unsigned y0, unsigned count) {
+                remaining |= fadeCells(&data[(size_t)x * numRows + y0], count, SIGNAL_FADE);
+            });
+            tiles[tile] = remaining;
         }
     }
 }
 
 
-// Fades the signals
 void Signals::fade(unsigned layerNum)
 {
-    constexpr unsigned fadeAmount = 1;
+    data[layerNum].fade();
+}
+
+
+// Also records the number of active tiles for numActiveTiles()
+void Signals::fade()
+{
+    activeTiles = 0;
+    for (Layer &layer : data) {
+        layer.fade();
+        activeTiles += layer.numActiveTiles();
+    }
+}
+
+// Weights of the diffusion stencil in units of 1/256. For the 5-point
+// stencil, corner is zero and the diagonal cells are never loaded.
+struct DiffusionWeights {
+    uint16_t center;
+    uint16_t edge;
+    uint16_t corner;
+};
+
+
+// Computes one output cell with bounds checks; cells outside the world
+// count as zero. Used only for the border cells.
+static uint8_t diffuseBorderCell(const uint8_t *in, int sizeX, int sizeY, int x, int y,
+                                 const DiffusionWeights &w)
+{
+    auto at = [&](int cx, int cy) -> unsigned {
+        return (cx < 0 || cx >= sizeX || cy < 0 || cy >= sizeY) ? 0 : in[(size_t)cx * sizeY + cy];
+    };
+    unsigned sum = w.center * at(x, y)
+                 + w.edge * (at(x - 1, y) + at(x + 1, y) + at(x, y - 1) + at(x, y + 1))
+                 + w.corner * (at(x - 1, y - 1) + at(x - 1, y + 1) + at(x + 1, y - 1) + at(x + 1, y + 1));
+    return sum >> 8;
+}
+
+
+// Computes interior rows first..last (inclusive) of one column with no
+// bounds checks. left, mid, and right are the input columns x-1, x, x+1.
+// The weights add up to at most 256, so every weighted sum fits in 16 bits.
+template <bool diagonals>
+static void diffuseInteriorColumn(const uint8_t *left, const uint8_t *mid, const uint8_t *right,
+                                  uint8_t *out, int first, int last, const DiffusionWeights &w)
+{
+    int y = first;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wCenter = _mm_set1_epi16(w.center);
+    const __m128i wEdge = _mm_set1_epi16(w.edge);
+    const __m128i wCorner = _mm_set1_epi16(w.corner);
+    auto load = [](const uint8_t *ptr) { return _mm_loadu_si128((const __m128i *)ptr); };
+    auto half = [&](__m128i c, __m128i n, __m128i s, __m128i wst, __m128i est,
+                    __m128i nw, __m128i sw, __m128i ne, __m128i se, bool high) {
+        auto widen = [&](__m128i v) { return high ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero); };
+        __m128i edges = _mm_add_epi16(_mm_add_epi16(widen(n), widen(s)), _mm_add_epi16(widen(wst), widen(est)));
+        __m128i acc = _mm_add_epi16(_mm_mullo_epi16(widen(c), wCenter), _mm_mullo_epi16(edges, wEdge));
+        if (diagonals) {
+            __m128i corners = _mm_add_epi16(_mm_add_epi16(widen(nw), widen(sw)), _mm_add_epi16(widen(ne), widen(se)));
+            acc = _mm_add_epi16(acc, _mm_mullo_epi16(corners, wCorner));
+        }
+        return _mm_srli_epi16(acc, 8);
+    };
+    for (; y + 15 <= last; y += 16) {
+        __m128i c = load(mid + y), n = load(mid + y + 1), s = load(mid + y - 1);
+        __m128i wst = load(left + y), est = load(right + y);
+        __m128i nw = zero, sw = zero, ne = zero, se = zero;
+        if (diagonals) {
+            nw = load(left + y + 1); sw = load(left + y - 1);
+            ne = load(right + y + 1); se = load(right + y - 1);
+        }
+        __m128i lo = half(c, n, s, wst, est, nw, sw, ne, se, false);
+        __m128i hi = half(c, n, s, wst, est, nw, sw, ne, se, true);
+        _mm_storeu_si128((__m128i *)(out + y), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; y + 7 <= last; y += 8) {
+        uint16x8_t edges = vaddq_u16(vaddl_u8(vld1_u8(mid + y + 1), vld1_u8(mid + y - 1)),
+                                     vaddl_u8(vld1_u8(left + y), vld1_u8(right + y)));
+        uint16x8_t acc = vmulq_n_u16(vmovl_u8(vld1_u8(mid + y)), w.center);
+        acc = vmlaq_n_u16(acc, edges, w.edge);
+        if (diagonals) {
+            uint16x8_t corners = vaddq_u16(vaddl_u8(vld1_u8(left + y + 1), vld1_u8(left + y - 1)),
+                                           vaddl_u8(vld1_u8(right + y + 1), vld1_u8(right + y - 1)));
+            acc = vmlaq_n_u16(acc, corners, w.corner);
+        }
+        vst1_u8(out + y, vshrn_n_u16(acc, 8));
+    }
+#endif
+    for (; y <= last; ++y) {
+        unsigned sum = w.center * mid[y]
+                     + w.edge * (mid[y + 1] + mid[y - 1] + left[y] + right[y]);
+        if (diagonals) {
+            sum += w.corner * (left[y + 1] + left[y - 1] + right[y + 1] + right[y - 1]);
+        }
+        out[y] = sum >> 8;
+    }
+}
+
+
+// Computes the output cells x0..x1-1, y0..y1-1 of one layer. The interior
+// is computed without bounds checks; only the one-cell border of the world
+// goes through the checked path.
+static void diffuseRegion(const uint8_t *in, uint8_t *out, int numCols, int numRows,
+                          int x0, int x1, int y0, int y1, bool diagonals, const DiffusionWeights &w)
+{
+    for (int x = x0; x < x1; ++x) {
+        uint8_t *outCol = out + (size_t)x * numRows;
+        if (x == 0 || x == numCols - 1 || numRows < 3) {
+            for (int y = y0; y < y1; ++y) {
+                outCol[y] = diffuseBorderCell(in, numCols, numRows, x, y, w);
+            }
+            continue;
+        }
+
+        const uint8_t *mid = in + (size_t)x * numRows;
+        const int first = std::max(1, y0);
+        const int last = std::min(numRows - 2, y1 - 1);
+        if (diagonals) {
+            diffuseInteriorColumn<true>(mid - numRows, mid, mid + numRows, outCol, first, last, w);
+        } else {
+            diffuseInteriorColumn<false>(mid - numRows, mid, mid + numRows, outCol, first, last, w);
+        }
+        if (y0 == 0) {
+            outCol[0] = diffuseBorderCell(in, numCols, numRows, x, 0, w);
+        }
+        if (y1 == numRows) {
+            outCol[numRows - 1] = diffuseBorderCell(in, numCols, numRows, x, numRows - 1, w);
+        }
+    }
+}
+
+
+// Spreads each signal layer with a 5- or 9-point stencil according to
+// p.signalDiffusion, reading the layer and writing its back buffer, then
+// swapping them. Signal can only spread into a tile from an active tile
+// or one of its eight neighbors, so only those tiles are computed. The
+// other tiles of the back buffer are zeroed if they still hold old data.
+// Lazy layers hold values that have not been decayed yet, so they are not
+// diffused.
+void Signals::diffuse()
+{
+    const Params &p = *world->params;
+    if (p.signalDiffusion == 0) {
+        return;
+    }
 
-    for (int16_t x = 0; x < p.sizeX; ++x) {
-        for (int16_t y = 0; y < p.sizeY; ++y) {
-            if (signals[layerNum][x][y] >= fadeAmount) {
-                signals[layerNum][x][y] -= fadeAmount;  // fade center cell
-            } else {
-                signals[layerNum][x][y] = 0;
+    const bool diagonals = (p.signalDiffusion == 9);
+    const DiffusionWeights w = { (uint16_t)p.signalDiffusionCenter, (uint16_t)p.signalDiffusionEdge,
+                                 (uint16_t)(diagonals ? p.signalDiffusionCorner : 0) };
+    if (w.center + 4 * w.edge + 4 * w.corner > 256) {
+        return; // see ParamManager::checkParameters()
+    }
+
+    for (Layer &layer : data) {
+        if (layer.isLazy()) {
+            continue;
+        }
+        layer.back.resize(layer.data.size());
+        layer.backTiles.resize(layer.tiles.size());
+
+        const int tilesX = layer.tiles.size() / layer.tilesY;
+        const int tilesY = layer.tilesY;
+        auto active = [&layer, tilesX, tilesY](int tx, int ty) {
+            return tx >= 0 && tx < tilesX && ty >= 0 && ty < tilesY && layer.tiles[(size_t)tx * tilesY + ty];
+        };
+
+        for (int tx = 0; tx < tilesX; ++tx) {
+            for (int ty = 0; ty < tilesY; ++ty) {
+                size_t tile = (size_t)tx * tilesY + ty;
+                bool reached = false;
+                for (int dx = -1; dx <= 1 && !reached; ++dx) {
+                    for (int dy = -1; dy <= 1 && !reached; ++dy) {
+                        reached = active(tx + dx, ty + dy);
+                    }
+                }
+
+                if (reached) {
+                    int x0 = tx * SIGNAL_TILE_SIZE;
+                    int y0 = ty * SIGNAL_TILE_SIZE;
+                    diffuseRegion(layer.data.data(), layer.back.data(), sizeX, sizeY,
+                                  x0, std::min<int>(sizeX, x0 + SIGNAL_TILE_SIZE),
+                                  y0, std::min<int>(sizeY, y0 + SIGNAL_TILE_SIZE), diagonals, w);
+                } else if (layer.backTiles[tile]) {
+                    layer.forEachTileColumn(tile, [&layer](unsigned x, unsigned y0, unsigned count) {
+                        std::fill_n(&layer.back[(size_t)x * layer.numRows + y0], count, 0);
+                    });
+                }
+                layer.backTiles[tile] = reached;
             }
         }
+
+        // backTiles now describes the new cells; swap it with tiles, which
+        // still describes the old ones
+        layer.data.swap(layer.back);
+        layer.tiles.swap(layer.backTiles);
     }
 }
 
@@ -28,22 +28,20 @@ namespace BS {
 extern void initializeGeneration0();
 extern unsigned spawnNewGeneration(unsigned generation, unsigned murderCount);
 extern void displaySampleGenomes(unsigned count);
-extern void executeActions(Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &actionLevels);
+extern void executeActions(World &w, Indiv &indiv, std::array<float, Action::NUM_ACTIONS> &actionLevels);
 extern void endOfSimStep(unsigned simStep, unsigned generation);
 extern void endOfGeneration(unsigned generation);
 
-static RunMode runMode = RunMode::STOP;
-static Grid grid;        // The 2D world where the creatures live
-static Signals signals;  // A 2D array of pheromones that overlay the world grid
-static Peeps peeps;      // The container of all the individuals in the population
-static ImageWriter imageWriter; // This is for generating the movies
-
+std::atomic<RunMode> runMode { RunMode::STOP };
 // The paramManager maintains a private copy of the parameter values, and a copy
-// is available read-only through global variable p. Although this is not
+// is available read-only through world->params. Although this is not
 // foolproof, you should be able to modify the config file during a simulation
 // run and modify many of the parameters. See params.cpp and params.h for more info.
+// A world with params of its own points its params there instead.
 static ParamManager paramManager;
-const Params &p { paramManager.getParamRef() }; // read-only params
+static World mainWorld;  // The world the app shows; island mode adds more
+thread_local World *world = &mainWorld;
+static ImageWriter imageWriter; // This is for generating the movies
 
 
 /**********************************************************************************************
@@ -52,29 +50,30 @@ Execute one simStep for one individual.
 This executes in its own thread, invoked from the main simulator thread. First we execute
 indiv.feedForward() which computes action values to be executed here. Some actions such as
 signal emission(s) (pheromones), agent movement, or deaths will have been queued for
-later execution at the end of the generation in single-threaded mode (the deferred queues
+later execution at the end of the sim step in single-threaded mode (the deferred queues
 allow the main data structures (e.g., grid, signals) to be freely accessed read-only in all threads).
 
 In order to be thread-safe, the main simulator-wide data structures and their
 accessibility are:
 
     grid - read-only
-    signals - (pheromones) read-write for the location where our agent lives
-        using signals.increment(), read-only for other locations
+    signals - (pheromones) read-only; emissions are queued with
+        signals.queueForIncrement() and applied at the end of the sim step
     peeps - for other individuals, we can only read their index and genome.
         We have read-write access to our individual through the indiv argument.
 
 The other important variables are:
 
+    w - the world our agent lives in, read once per sim step by the caller
     simStep - the current age of our agent, reset to 0 at the start of each generation.
          For many simulation scenarios, this matches our indiv.age member.
-    randomUint - global random number generator, a private instance is given to each thread
+    randomUint - global random number generator, a private (thread_local) instance is given to each thread
 **********************************************************************************************/
-void simStepOneIndiv(Indiv &indiv, unsigned simStep)
+void simStepOneIndiv(World &w, Indiv &indiv, unsigned simStep)
 {
     if(indiv.alive == true) ++indiv.age; // for this implementation, tracks simStep
-    auto actionLevels = indiv.feedForward(simStep);
-    executeActions(indiv, actionLevels);
+    auto actionLevels = indiv.feedForward(w, simStep);
+    executeActions(w, indiv, actionLevels);
 }
 
 
@@ -107,21 +106,31 @@ The important simulator-wide variables are:
 The threads are:
     main thread - simulator
     simStepOneIndiv() - child threads created by the main simulator thread
+    initializeNewGeneration() - p.numThreads short-lived threads that build the
+        children's genomes and neural nets
+    islands - if p.numIslands > 1, one thread per extra world (see islands.cpp)
+    sweep workers - one world each while a parameter sweep runs (see sweep.cpp)
     imageWriter - saves image frames used to make a movie (possibly not threaded
         due to unresolved bugs when threaded)
 ********************************************************************************/
 
 static unsigned generation  = 0;
 static unsigned survivors   = 0;
-static double   diversity   = 0.0;
 static unsigned murderCount = 0;
 
 static void DoSimStep( void * _ctx )
 {
+    world = &mainWorld;
+    const Params &p = *mainWorld.params;
+    Peeps &peeps = mainWorld.peeps;
     randomUint.initialize(); // seed the RNG, each thread has a private instance
 
     while(generation < p.maxGenerations) { // generation loop
 
+        // Checkpoints requested through the Lua bindings are saved and
+        // restored here, between generations
+        serviceCheckpointRequests(generation, survivors);
+
         if(runMode == RunMode::RUN) {
             murderCount = 0; // for reporting purposes
 
@@ -131,7 +140,7 @@ static void DoSimStep( void * _ctx )
                 //#pragma omp for schedule(auto)
                 for (unsigned indivIndex = 1; indivIndex <= p.population; ++indivIndex) {
                     if (peeps[indivIndex].alive) {
-                        simStepOneIndiv(peeps[indivIndex], simStep);
+                        simStepOneIndiv(mainWorld, peeps[indivIndex], simStep);
                     }
                 }
 
@@ -171,20 +180,23 @@ void simulator(char *argv)
 {
     printSensorsActions(); // show the agents' capabilities
 
-    // Simulator parameters are available read-only through the global
-    // variable p after paramManager is initialized.
+    // Simulator parameters are available read-only through world->params
+    // after paramManager is initialized.
     // Todo: remove the hardcoded parameter filename.
+    world = &mainWorld;
+    mainWorld.params = &paramManager.getParamRef();
     paramManager.setDefaults();
     paramManager.registerConfigFile(argv);
     paramManager.updateFromConfigFile(0);
     paramManager.checkParameters(); // check and report any problems
+    const Params &p = *mainWorld.params;
     randomUint.initialize(); // seed the RNG for main-thread use
 
     // Allocate container space. Once allocated, these container elements
     // will be reused in each new generation.
-    grid.init(p.sizeX, p.sizeY); // the land on which the peeps live
-    signals.init(p.signalLayers, p.sizeX, p.sizeY);  // where the pheromones waft
-    peeps.init(p.population); // the peeps themselves
+    mainWorld.grid.init(p.sizeX, p.sizeY); // the land on which the peeps live
+    mainWorld.signals.init(p.signalLayers, p.sizeX, p.sizeY, p.lazySignalFade, p.numThreads);  // where the pheromones waft
+    mainWorld.peeps.init(p.population); // the peeps themselves
 
     // If imageWriter is to be run in its own thread, start it here:
     //std::thread t(&ImageWriter::saveFrameThread, &imageWriter);
@@ -193,9 +205,11 @@ void simulator(char *argv)
     // Unit tests:
     //unitTestConnectNeuralNetWiringFromGenome();
     //unitTestGridVisitNeighborhood();
+    //unitTestGenomeCompare();
 
     initializeGeneration0(); // starting population
     runMode = RunMode::PAUSE;
+    startIslands(); // more worlds, if p.numIslands > 1
 
     //#pragma omp single
     dmThread::New(DoSimStep, 0x80000, nullptr, "biosim_thread");
@@ -212,6 +226,8 @@ void simulationStep( void )
 
 void simulationDone( void ) 
 {
+    stopIslands();
+    stopSweep();
     displaySampleGenomes(3); // final report, for debugging
 
     std::cout << "Simulator exit." << std::endl;
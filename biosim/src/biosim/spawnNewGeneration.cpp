@@ -5,6 +5,8 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <thread>
+#include <cmath>
 #include "simulator.h"
 
 namespace BS {
@@ -12,44 +14,185 @@ namespace BS {
 extern std::pair<bool, float> passedSurvivalCriterion(const Indiv &indiv, unsigned challenge);
 
 
+// For a newborn that found no empty location: it stays off the grid and
+// dead for this generation
+static void keepOffGrid(Indiv &indiv)
+{
+    indiv.alive = false;
+    indiv.loc = indiv.birthLoc = Coord { 0, 0 };
+}
+
+
+// Reports the newborns kept off the grid and takes them out of the totals
+// over the living
+static void dropUnplaced(unsigned numUnplaced)
+{
+    const Params &p = *world->params;
+    if (numUnplaced == 0) {
+        return;
+    }
+    std::cerr << "The grid is full: " << numUnplaced << " of " << p.population
+              << " newborns could not be placed and sit out this generation" << std::endl;
+    for (uint16_t index = 1; index <= p.population; ++index) {
+        if (!world->peeps[index].alive) {
+            world->livingStats.remove(world->peeps[index]);
+        }
+    }
+}
+
+
 // Requires that the grid, signals, and peeps containers have been allocated.
 // This will erase the grid and signal layers, then create a new population in
 // the peeps container at random locations with random genomes.
 void initializeGeneration0()
 {
+    const Params &p = *world->params;
+    Grid &grid = world->grid;
+    Peeps &peeps = world->peeps;
+
     // The grid has already been allocated, just clear and reuse it
     grid.zeroFill();
     grid.createBarrier(p.barrierType);
 
     // The signal layers have already been allocated, so just reuse them
-    signals.zeroFill();
+    world->signals.zeroFill();
+
+    // Memoized similarity scores refer to the outgoing population
+    clearGenomeSimilarityCache();
 
     // Spawn the population. The peeps container has already been allocated,
     // just clear and reuse it
+    const uint64_t firstId = world->lineage.newIds(p.population);
+    world->populationStats.clear();
+    unsigned numUnplaced = 0;
     for (uint16_t index = 1; index <= p.population; ++index) {
-        peeps[index].initialize(index, grid.findEmptyLocation(), makeRandomGenome());
+        Genome genome = makeRandomGenome();
+        Coord loc;
+        const bool found = grid.findEmptyLocation(loc);
+        peeps[index].initialize(index, std::move(genome));
+        if (found) {
+            peeps[index].place(grid, loc);
+        } else {
+            keepOffGrid(peeps[index]);
+            ++numUnplaced;
+        }
+        peeps[index].id = firstId + index - 1;
+        peeps[index].parentIds = { 0, 0 };
+        world->populationStats.add(peeps[index]);
     }
+    world->livingStats = world->populationStats;
+    dropUnplaced(numUnplaced);
+
+    // A new start has no ancestors on record
+    world->lineage.clear();
+    world->lineage.addGeneration(0, peeps, p.population);
+    world->species.clear();
+    if (p.speciesClustering) {
+        world->species.update(peeps, p.population, p.speciesSimilarity);
+    }
+    world->wiredMaxNumberNeurons = p.maxNumberNeurons;
+    world->wiringReuseRate = 0.0;
 }
 
 
-// Requires a container with one or more parent genomes to choose from.
+// Requires an arena with one or more parent genomes to choose from, and the
+// ids of those parents. The parents must not be stored in peeps[] because
+// each child's genome is written over the genome vector of the Indiv it
+// replaces.
 // Called from spawnNewGeneration(). This requires that the grid, signals, and
 // peeps containers have been allocated. This will erase the grid and signal
 // layers, then create a new population in the peeps container with random
 // locations and genomes derived from the container of parent genomes.
-void initializeNewGeneration(const std::vector<Genome> &parentGenomes, unsigned generation)
+void initializeNewGeneration(const GenomeArena &parentGenomes, const WiringArena &parentWirings,
+                             const std::vector<uint64_t> &parentIds, const AliasTable &parentSelector,
+                             unsigned generation)
 {
-    extern Genome generateChildGenome(const std::vector<Genome> &parentGenomes);
+    const Params &p = *world->params;
+    extern int generateChildGenome(const GenomeArena &parentGenomes, const AliasTable &parentSelector,
+                                   Genome &genome, std::array<int, 2> &parents);
 
     // The grid, signals, and peeps containers have already been allocated, just
     // clear them if needed and reuse the elements
+    Grid &grid = world->grid;
+    Peeps &peeps = world->peeps;
     grid.zeroFill();
     grid.createBarrier(p.barrierType);
-    signals.zeroFill();
+    world->signals.zeroFill();
+    clearGenomeSimilarityCache();
+
+    // Spawn the population. This overwrites all the elements of peeps[].
+    // Each child's genome and neural net are built on one of p.numThreads
+    // threads from a private RNG stream keyed by the generation seed and the
+    // child's index, so the result does not depend on the number of threads
+    // or on how the children are divided among them. A child whose genome is
+    // identical to a parent's copies the parent's wiring if it is available.
+    // Each thread also totals its own children for populationStats.
+    const uint32_t generationSeed = randomUint();
+    const uint64_t firstId = world->lineage.newIds(p.population);
+    const unsigned numThreads = std::max(1U, std::min(p.numThreads, p.population));
+    const bool reuseWiring = (parentWirings.size() == parentGenomes.size());
+    std::vector<unsigned> reuseCounts(numThreads, 0);
+    std::vector<PopulationStats> threadStats(numThreads);
+
+    World *const parentWorld = world;
+    auto buildChildren = [&, generationSeed, numThreads, reuseWiring](unsigned threadNum) {
+        world = parentWorld;
+        std::array<int, 2> parents;
+        for (unsigned index = 1 + threadNum; index <= p.population; index += numThreads) {
+            randomUint.initialize(generationSeed, index);
+            int sameAsParent = generateChildGenome(parentGenomes, parentSelector, peeps[index].genome, parents);
+            peeps[index].id = firstId + index - 1;
+            peeps[index].parentIds = { parentIds[parents[0]], parents[1] >= 0 ? parentIds[parents[1]] : 0 };
+            bool wired = reuseWiring && sameAsParent >= 0;
+            if (wired) {
+                parentWirings.copyTo(sameAsParent, peeps[index].nnet);
+                ++reuseCounts[threadNum];
+            }
+            peeps[index].initialize(index, wired);
+            threadStats[threadNum].add(peeps[index]);
+        }
+    };
 
-    // Spawn the population. This overwrites all the elements of peeps[]
+    std::vector<std::thread> workers;
+    for (unsigned threadNum = 1; threadNum < numThreads; ++threadNum) {
+        workers.emplace_back(buildChildren, threadNum);
+    }
+    const RandomUintGenerator savedRandomUint = randomUint;
+    buildChildren(0);
+    randomUint = savedRandomUint;
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    unsigned reuseCount = 0;
+    for (unsigned count : reuseCounts) {
+        reuseCount += count;
+    }
+    world->wiringReuseRate = (float)reuseCount / p.population;
+    world->populationStats.clear();
+    for (const PopulationStats &stats : threadStats) {
+        world->populationStats.merge(stats);
+    }
+    world->livingStats = world->populationStats;
+    world->wiredMaxNumberNeurons = p.maxNumberNeurons;
+
+    // Placement uses this thread's RNG and the grid, so it stays serial
+    unsigned numUnplaced = 0;
     for (uint16_t index = 1; index <= p.population; ++index) {
-        peeps[index].initialize(index, grid.findEmptyLocation(), generateChildGenome(parentGenomes));
+        Coord loc;
+        if (grid.findEmptyLocation(loc)) {
+            peeps[index].place(grid, loc);
+        } else {
+            keepOffGrid(peeps[index]);
+            ++numUnplaced;
+        }
+    }
+    dropUnplaced(numUnplaced);
+    world->lineage.addGeneration(generation, peeps, p.population);
+    if (p.speciesClustering) {
+        world->species.update(peeps, p.population, p.speciesSimilarity);
+    } else {
+        world->species.clear();
     }
 }
 
@@ -59,25 +202,38 @@ void initializeNewGeneration(const std::vector<Genome> &parentGenomes, unsigned
 // world grid.
 // In order to redistribute the new population randomly, we will save all the
 // surviving genomes in a container, then clear the grid of indexes and generate
-// new individuals. This is inefficient when there are lots of survivors because
-// we could have reused (with mutations) the survivors' genomes and neural
-// nets instead of rebuilding them.
+// new individuals. Children that come out identical to a parent copy the
+// parent's neural net instead of rebuilding it; see wiringReuseRate.
 // Returns number of survivor-reproducers.
 // Must be called in single-thread mode between generations.
 unsigned spawnNewGeneration(unsigned generation, unsigned murderCount)
 {
+    const Params &p = *world->params;
     unsigned sacrificedCount = 0; // for the altruism challenge
+    const Peeps &peeps = world->peeps;
 
     extern void appendEpochLog(unsigned generation, unsigned numberSurvivors, unsigned murderCount);
     extern std::pair<bool, float> passedSurvivalCriterion(const Indiv &indiv, unsigned challenge);
     extern void displaySignalUse();
 
     // This container will hold the indexes and survival scores (0.0..1.0)
-    // of all the survivors who will provide genomes for repopulation.
+    // of all the survivors who will provide genomes for repopulation. They
+    // are not sorted; parents are chosen by fitness with parentSelector.
     std::vector<std::pair<uint16_t, float>> parents; // <indiv index, score>
 
-    // This container will hold the genomes of the survivors
-    std::vector<Genome> parentGenomes;
+    // This arena will hold the genomes of the survivors. It persists across
+    // generations so that its buffer is reused rather than reallocated; each
+    // world is always spawned on the same thread, so it gets its own arena.
+    // A parent's wiring can be reused only if it was built with the same
+    // parameters that createWiringFromGenome() would use now.
+    thread_local GenomeArena parentGenomes;
+    parentGenomes.clear();
+    thread_local WiringArena parentWirings;
+    parentWirings.clear();
+    thread_local std::vector<uint64_t> parentIds; // Indiv::id of each genome in the arena
+    parentIds.clear();
+    const bool saveWirings = (world->wiredMaxNumberNeurons == p.maxNumberNeurons);
+    thread_local AliasTable parentSelector;
 
     if (p.challenge != CHALLENGE_ALTRUISM) {
         // First, make a list of all the individuals who will become parents; save
@@ -123,25 +279,49 @@ unsigned spawnNewGeneration(unsigned generation, unsigned murderCount)
         constexpr unsigned altruismFactor = 10; // the saved:sacrificed ratio
 
         if (considerKinship) {
-            if (generation > generationToApplyKinship) {
-                // Todo: optimize!!!
+            if (generation > generationToApplyKinship && !parents.empty()) {
                 float threshold = 0.7;
 
+                // For each sacrificed agent, find its kin among the parents once:
+                // the LSH index proposes candidates and only those are compared
+                // exactly. Each pass then picks the first kin at or after a random
+                // starting point (wrapping around), as a linear scan of parents[]
+                // from that point would, so we don't keep using the same one.
+                std::vector<const Genome *> parentGenomePtrs;
+                std::vector<const GenomeSketch *> parentSketchPtrs;
+                parentGenomePtrs.reserve(parents.size());
+                parentSketchPtrs.reserve(parents.size());
+                for (const std::pair<uint16_t, float> &parent : parents) {
+                    parentGenomePtrs.push_back(&peeps[parent.first].genome);
+                    parentSketchPtrs.push_back(&peeps[parent.first].sketch);
+                }
+                GenomeLshIndex kinIndex;
+                kinIndex.build(parentGenomePtrs, parentSketchPtrs);
+
+                std::vector<std::vector<uint32_t>> kinOf(sacrificesIndexes.size());
+                std::vector<uint32_t> candidates;
+                for (unsigned n = 0; n < sacrificesIndexes.size(); ++n) {
+                    const Indiv &indiv1 = peeps[sacrificesIndexes[n]];
+                    kinIndex.findCandidates(indiv1.genome, indiv1.sketch, candidates);
+                    for (uint32_t candidate : candidates) {
+                        const Indiv &indiv2 = peeps[parents[candidate].first];
+                        float similarity = genomeSimilarity(indiv1.fingerprint, indiv1.genome,
+                                                            indiv2.fingerprint, indiv2.genome);
+                        if (similarity >= threshold) {
+                            kinOf[n].push_back(candidate); // stays sorted
+                        }
+                    }
+                }
+
                 std::vector<std::pair<uint16_t, float>> survivingKin;
                 for (unsigned passes = 0; passes < altruismFactor; ++passes) {
-                    for (uint16_t sacrificedIndex : sacrificesIndexes) {
-                        // randomize the next loop so we don't keep using the first one repeatedly
+                    for (unsigned n = 0; n < sacrificesIndexes.size(); ++n) {
                         unsigned startIndex = randomUint(0, parents.size() - 1);
-                        for (unsigned count = 0; count < parents.size(); ++count) {
-                            const std::pair<uint16_t, float> &possibleParent = parents[(startIndex + count) % parents.size()];
-                            const Genome &g1 = peeps[sacrificedIndex].genome;
-                            const Genome &g2 = peeps[possibleParent.first].genome;
-                            float similarity = genomeSimilarity(g1, g2);
-                            if (similarity >= threshold) {
-                                survivingKin.push_back(possibleParent);
-                                // mark this one so we don't use it again?
-                                break;
-                            }
+                        const std::vector<uint32_t> &kin = kinOf[n];
+                        if (!kin.empty()) {
+                            auto it = std::lower_bound(kin.begin(), kin.end(), startIndex);
+                            survivingKin.push_back(parents[it != kin.end() ? *it : kin.front()]);
+                            // mark this one so we don't use it again?
                         }
                     }
                 }
@@ -160,28 +340,44 @@ unsigned spawnNewGeneration(unsigned generation, unsigned murderCount)
         }
     }
 
-    // Sort the indexes of the parents by their fitness scores
-    std::sort(parents.begin(), parents.end(),
-        [](const std::pair<uint16_t, float> &parent1, const std::pair<uint16_t, float> &parent2) {
-            return parent1.second > parent2.second;
-        });
-
-    // Assemble a list of all the parent genomes. These will be ordered by their
-    // scores if the parents[] container was sorted by score
-    parentGenomes.reserve(parents.size());
+    // Copy all the parent genomes into the arena, and build a table for
+    // choosing them with probability proportional to score^selectionPressure
+    thread_local std::vector<float> parentWeights;
+    parentWeights.clear();
     for (const std::pair<uint16_t, float> &parent : parents) {
-        parentGenomes.push_back(peeps[parent.first].genome);
+        parentGenomes.append(peeps[parent.first].genome);
+        parentIds.push_back(peeps[parent.first].id);
+        if (saveWirings) {
+            parentWirings.append(peeps[parent.first].nnet);
+        }
+        parentWeights.push_back(std::pow(std::max(0.0f, parent.second), p.selectionPressure));
+    }
+
+    // In island mode, the best parents are traded with the neighboring
+    // islands now and then. The migrants join the parents; they bring no
+    // wirings along.
+    if (exchangeMigrants(generation, parents, parentGenomes, parentIds, parentWeights)) {
+        parentWirings.clear();
     }
+    parentSelector.build(parentWeights);
+
+    // The genomes of this generation have not changed since it was spawned,
+    // so its diversity is computed once, here, for the log and the UI
+    world->diversity = geneticDiversity();
+    world->diversityEstimate = estimateDiversity();
 
     // std::cout << "Gen " << generation << ", " << parentGenomes.size() << " survivors" << std::endl;
-    appendEpochLog(generation, parentGenomes.size(), murderCount);
+    if (world->primary) {
+        appendEpochLog(generation, parentGenomes.size(), murderCount);
+        archiveGenomes(generation, parentGenomes);
+    }
     //displaySignalUse(); // for debugging only
 
     // Now we have a container of zero or more parents' genomes
 
     if (!parentGenomes.empty()) {
         // Spawn a new generation
-        initializeNewGeneration(parentGenomes, generation + 1);
+        initializeNewGeneration(parentGenomes, parentWirings, parentIds, parentSelector, generation + 1);
     } else {
         // Special case: there are no surviving parents: start the simulation over
         // from scratch with randomly-generated genomes
@@ -0,0 +1,149 @@
+// species.cpp -- species clustering of each new generation
+
+// An individual's signature is the low two bits of each slot of its genome
+// sketch, packed into 64 bits. Two sketches that agree in a slot agree in its
+// two bits, and two that don't still agree in them one time in four, so if
+// two signatures agree in a fraction a of their slots, the gene sets they
+// stand for have a Jaccard similarity of about (a - 1/4) / (3/4).
+//
+// update() takes the previous generation's species, largest first, as the
+// leaders. Each individual, in index order, joins the first leader within
+// the similarity threshold, or else becomes the leader of a new species;
+// once there are maxSpecies leaders, it joins the nearest one instead. Then
+// each species' centroid becomes the most common two-bit value of each slot
+// among its members, the species with no members are dropped, and the rest
+// are sorted by size. The cost is the population times the number of
+// leaders tried, which is usually a few and never more than maxSpecies.
+
+#include <algorithm>
+#include "simulator.h"
+
+namespace BS {
+
+static_assert(genomeSketchSize == 32, "two signature bits per sketch slot");
+
+static uint64_t speciesSignature(const GenomeSketch &sketch)
+{
+    uint64_t signature = 0;
+    for (unsigned slot = 0; slot < genomeSketchSize; ++slot) {
+        signature |= (uint64_t)(sketch[slot] & 3) << (2 * slot);
+    }
+    return signature;
+}
+
+
+static unsigned differingSlots(uint64_t signature1, uint64_t signature2)
+{
+    const uint64_t diff = signature1 ^ signature2;
+    return __builtin_popcountll((diff | (diff >> 1)) & 0x5555555555555555ULL);
+}
+
+
+void Species::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    clusters.clear();
+    members.clear();
+}
+
+
+// Must be called in single-thread mode, after the generation is spawned
+void Species::update(const Peeps &peeps, unsigned population, float minSimilarity)
+{
+    // The most slots that may differ for an estimated similarity of at
+    // least minSimilarity
+    const unsigned maxDiffering = genomeSketchSize * (1.0f - (0.25f + 0.75f * minSimilarity));
+
+    std::vector<Cluster> newClusters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        newClusters = clusters;
+    }
+    for (Cluster &cluster : newClusters) {
+        cluster.size = 0;
+    }
+
+    std::vector<uint32_t> newMembers(population + 1, 0);
+    std::vector<uint32_t> clusterOf(population + 1, 0);
+    signatures.resize(population + 1);
+
+    for (uint16_t index = 1; index <= population; ++index) {
+        const uint64_t signature = speciesSignature(peeps[index].sketch);
+        signatures[index] = signature;
+
+        unsigned nearest = 0;
+        unsigned nearestDiffering = genomeSketchSize + 1;
+        for (unsigned c = 0; c < newClusters.size(); ++c) {
+            const unsigned differing = differingSlots(signature, newClusters[c].centroid);
+            if (differing < nearestDiffering) {
+                nearest = c;
+                nearestDiffering = differing;
+                if (differing <= maxDiffering) {
+                    break;
+                }
+            }
+        }
+        if (nearestDiffering > maxDiffering && newClusters.size() < maxSpecies) {
+            nearest = newClusters.size();
+            newClusters.push_back({ nextId++, 0, signature });
+        }
+        ++newClusters[nearest].size;
+        clusterOf[index] = nearest;
+    }
+
+    // New centroids: slotCounts holds four counts per slot per cluster
+    slotCounts.assign(newClusters.size() * genomeSketchSize * 4, 0);
+    for (uint16_t index = 1; index <= population; ++index) {
+        uint32_t *counts = &slotCounts[clusterOf[index] * genomeSketchSize * 4];
+        for (unsigned slot = 0; slot < genomeSketchSize; ++slot) {
+            ++counts[slot * 4 + ((signatures[index] >> (2 * slot)) & 3)];
+        }
+    }
+    for (unsigned c = 0; c < newClusters.size(); ++c) {
+        if (newClusters[c].size == 0) {
+            continue;
+        }
+        const uint32_t *counts = &slotCounts[c * genomeSketchSize * 4];
+        uint64_t centroid = 0;
+        for (unsigned slot = 0; slot < genomeSketchSize; ++slot) {
+            const uint32_t *slotCount = &counts[slot * 4];
+            const uint64_t mode = std::max_element(slotCount, slotCount + 4) - slotCount;
+            centroid |= mode << (2 * slot);
+        }
+        newClusters[c].centroid = centroid;
+    }
+
+    for (uint16_t index = 1; index <= population; ++index) {
+        newMembers[index] = newClusters[clusterOf[index]].id;
+    }
+    newClusters.erase(std::remove_if(newClusters.begin(), newClusters.end(),
+                                     [](const Cluster &cluster) { return cluster.size == 0; }),
+                      newClusters.end());
+    std::stable_sort(newClusters.begin(), newClusters.end(),
+                     [](const Cluster &a, const Cluster &b) { return a.size > b.size; });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    clusters = std::move(newClusters);
+    members = std::move(newMembers);
+}
+
+
+uint32_t Species::speciesOf(uint16_t index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return index < members.size() ? members[index] : 0;
+}
+
+
+std::vector<std::pair<uint32_t, uint32_t>> Species::sizes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<uint32_t, uint32_t>> result;
+    result.reserve(clusters.size());
+    for (const Cluster &cluster : clusters) {
+        result.push_back({ cluster.id, cluster.size });
+    }
+    return result;
+}
+
+} // end namespace BS
@@ -9,10 +9,12 @@ namespace BS {
 // Returns true and a score 0.0..1.0 if passed, false if failed
 std::pair<bool, float> passedSurvivalCriterion(const Indiv &indiv, unsigned challenge)
 {
+    const Params &p = *world->params;
     if (!indiv.alive) {
         return { false, 0.0 };
     }
 
+    const Grid &grid = world->grid;
     switch(challenge) {
 
     // Survivors are those inside the circular area defined by
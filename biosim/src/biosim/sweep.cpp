@@ -0,0 +1,283 @@
+// sweep.cpp -- in-process parameter sweeps
+
+// A sweep runs one simulation for every combination of the values in a
+// sweep file, on top of a base config file, several runs at a time, and
+// writes one line per run to a CSV results file. A sweep file looks like a
+// config file whose values are comma-separated lists:
+//
+//     maxGenerations = 100
+//     sizeX = 64
+//     sizeY = 64
+//     pointMutationRate = 0.0005, 0.001, 0.002
+//     challenge = 6, 10
+//
+// which makes six runs. The last name varies fastest. Generation-specific
+// values (name@generation) in the base config take effect as usual, but the
+// swept values override them.
+//
+// Each worker thread owns a World with Params of its own and steps one run
+// at a time from start to finish, like an island without migration and
+// without videos, logs, archives, or checkpoints. Each run builds its
+// children on one thread (numThreads = 1) unless the sweep file says
+// otherwise, because the concurrent runs already keep the cores busy. A
+// worker that finishes a run claims the next one that has not started, so
+// long and short runs even out across the workers. A run stops after
+// p.maxGenerations generations, counting any restarts after an extinction.
+//
+// Each results line holds the run number, the swept values, the number of
+// generations, the survivors and genetic diversity of the last generation,
+// the wall time in seconds, and the sim steps per second.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+extern void initializeGeneration0();
+extern unsigned spawnNewGeneration(unsigned generation, unsigned murderCount);
+extern void simStepOneIndiv(World &w, Indiv &indiv, unsigned simStep);
+extern void endOfSimStep(unsigned simStep, unsigned generation);
+
+namespace {
+
+struct SweepAxis {
+    std::string name;
+    std::vector<std::string> values;
+};
+
+std::vector<SweepAxis> axes;
+std::string baseConfigFile;
+unsigned numRuns = 0;
+std::atomic<unsigned> nextRun { 0 };
+std::atomic<unsigned> runsDone { 0 };
+std::atomic<bool> stopRequested { false };
+std::vector<std::thread> workers;
+
+std::ofstream results;
+std::mutex resultsMutex;
+
+}
+
+
+// Returns false if the file can't be read or a line is not name = values
+static bool readSweepFile(const std::string &filename, std::vector<SweepAxis> &axes)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open sweep file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
+        if (line.empty()) {
+            continue;
+        }
+        auto delimiterPos = line.find('=');
+        if (delimiterPos == std::string::npos || delimiterPos == 0) {
+            std::cerr << "Invalid sweep line: " << line << std::endl;
+            return false;
+        }
+
+        SweepAxis axis;
+        axis.name = line.substr(0, delimiterPos);
+        std::istringstream values(line.substr(delimiterPos + 1));
+        std::string value;
+        while (std::getline(values, value, ',')) {
+            if (value.empty()) {
+                std::cerr << "Invalid sweep line: " << line << std::endl;
+                return false;
+            }
+            axis.values.push_back(value);
+        }
+        if (axis.values.empty()) {
+            std::cerr << "Invalid sweep line: " << line << std::endl;
+            return false;
+        }
+        axes.push_back(std::move(axis));
+    }
+    return true;
+}
+
+
+// Reads the base config for the given generation, then applies the run's
+// values on top
+static void configureRun(ParamManager &runParams, const std::vector<std::string> &values,
+                         unsigned generation)
+{
+    runParams.updateFromConfigFile(generation);
+    runParams.setParameter("numThreads", "1");
+    runParams.setParameter("numIslands", "1");
+    for (size_t n = 0; n < axes.size(); ++n) {
+        runParams.setParameter(axes[n].name, values[n]);
+    }
+}
+
+
+// Runs one combination of values in the calling worker's world
+static void runOne(World &runWorld, ParamManager &runParams, unsigned run)
+{
+    const Params &p = *runWorld.params;
+    std::vector<std::string> values(axes.size());
+    unsigned rest = run;
+    for (size_t n = axes.size(); n-- > 0; ) {
+        values[n] = axes[n].values[rest % axes[n].values.size()];
+        rest /= axes[n].values.size();
+    }
+
+    runParams.setDefaults();
+    runParams.registerConfigFile(baseConfigFile.c_str());
+    configureRun(runParams, values, 0);
+    randomUint.initialize();
+
+    Peeps &peeps = runWorld.peeps;
+    runWorld.grid.init(p.sizeX, p.sizeY);
+    runWorld.signals.init(p.signalLayers, p.sizeX, p.sizeY, p.lazySignalFade, p.numThreads);
+    peeps.init(p.population);
+    initializeGeneration0();
+
+    auto startTime = std::chrono::steady_clock::now();
+    unsigned generation = 0;
+    unsigned generationsRun = 0;
+    unsigned numberSurvivors = 0;
+    uint64_t simSteps = 0;
+    while (generationsRun < p.maxGenerations && !stopRequested) {
+        unsigned murderCount = 0;
+        for (unsigned simStep = 0; simStep < p.stepsPerGeneration; ++simStep) {
+            for (unsigned indivIndex = 1; indivIndex <= p.population; ++indivIndex) {
+                if (peeps[indivIndex].alive) {
+                    simStepOneIndiv(runWorld, peeps[indivIndex], simStep);
+                }
+            }
+            murderCount += peeps.deathQueueSize();
+            endOfSimStep(simStep, generation);
+        }
+        simSteps += p.stepsPerGeneration;
+
+        configureRun(runParams, values, generation + 1);
+        numberSurvivors = spawnNewGeneration(generation, murderCount);
+        generation = (numberSurvivors == 0) ? 0 : generation + 1;
+        ++generationsRun;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    results << run;
+    for (const std::string &value : values) {
+        results << ',' << value;
+    }
+    results << ',' << generationsRun << ',' << numberSurvivors << ',' << runWorld.diversity
+            << ',' << seconds << ',' << (seconds > 0.0 ? simSteps / seconds : 0.0) << std::endl;
+}
+
+
+static void sweepWorker()
+{
+    World runWorld;
+    ParamManager runParams;
+    runWorld.params = &runParams.getParamRef();
+    runWorld.primary = false;
+    world = &runWorld;
+
+    unsigned run;
+    while (!stopRequested && (run = nextRun++) < numRuns) {
+        runOne(runWorld, runParams, run);
+        ++runsDone;
+    }
+}
+
+
+// Starts a sweep in the background on numWorkers threads (0 means one per
+// core). Returns false, with a message on stderr, if a sweep is already
+// running or the files or values are not usable.
+bool startSweep(const std::string &configFile, const std::string &sweepFile,
+                const std::string &resultsFile, unsigned numWorkers)
+{
+    if (!workers.empty() && runsDone < numRuns) {
+        std::cerr << "A sweep is already running" << std::endl;
+        return false;
+    }
+    stopSweep();
+
+    std::vector<SweepAxis> newAxes;
+    if (!readSweepFile(sweepFile, newAxes) || !std::ifstream(configFile).is_open()) {
+        std::cerr << "Sweep not started" << std::endl;
+        return false;
+    }
+
+    // Reject unknown names and invalid values before anything runs
+    unsigned count = 1;
+    ParamManager check;
+    check.setDefaults();
+    for (const SweepAxis &axis : newAxes) {
+        for (const std::string &value : axis.values) {
+            if (!check.setParameter(axis.name, value)) {
+                std::cerr << "Sweep not started" << std::endl;
+                return false;
+            }
+        }
+        count *= axis.values.size();
+    }
+
+    results.close();
+    results.clear();
+    results.open(resultsFile, std::ios::trunc);
+    if (!results.is_open()) {
+        std::cerr << "Couldn't open sweep results file " << resultsFile << std::endl;
+        return false;
+    }
+    results << "run";
+    for (const SweepAxis &axis : newAxes) {
+        results << ',' << axis.name;
+    }
+    results << ",generations,survivors,diversity,seconds,stepsPerSec" << std::endl;
+
+    axes = std::move(newAxes);
+    baseConfigFile = configFile;
+    numRuns = count;
+    nextRun = 0;
+    runsDone = 0;
+    stopRequested = false;
+
+    if (numWorkers == 0) {
+        numWorkers = std::max(1U, std::thread::hardware_concurrency());
+    }
+    numWorkers = std::min(numWorkers, numRuns);
+    for (unsigned n = 0; n < numWorkers; ++n) {
+        workers.emplace_back(sweepWorker);
+    }
+    std::cout << "Sweep of " << numRuns << " runs started on " << numWorkers << " threads" << std::endl;
+    return true;
+}
+
+
+// Stops a sweep between generations and waits for the workers. The runs
+// cut short are still reported.
+void stopSweep()
+{
+    stopRequested = true;
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+
+void sweepProgress(unsigned &done, unsigned &total)
+{
+    done = runsDone;
+    total = numRuns;
+}
+
+} // end namespace BS
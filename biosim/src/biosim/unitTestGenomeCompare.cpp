@@ -0,0 +1,65 @@
+// unitTestGenomeCompare.cpp
+// This checks the bit-parallel LCS similarity of genomeComparisonMethod 0
+// against a plain dynamic-programming LCS, including the word boundaries
+// of the bit vector and genomes too long for the stack buffers.
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "simulator.h"
+
+namespace BS {
+
+extern float lcsSimilarity(const Genome &genome1, const Genome &genome2);
+
+static unsigned referenceLcs(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+{
+    std::vector<unsigned> row(b.size() + 1, 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        unsigned diagonal = 0;
+        for (size_t j = 0; j < b.size(); ++j) {
+            const unsigned above = row[j + 1];
+            row[j + 1] = (a[i] == b[j]) ? diagonal + 1 : std::max(above, row[j]);
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+
+bool unitTestGenomeCompare()
+{
+    // A fixed LCG so that the test does not draw from randomUint; the small
+    // alphabet makes long common subsequences likely
+    uint32_t state = 12345;
+    auto next = [&]() { state = state * 1664525U + 1013904223U; return state >> 8; };
+
+    const unsigned lengths[] = { 0, 1, 2, 24, 63, 64, 65, 127, 128, 129, 300, 384, 385, 500 };
+    for (unsigned length1 : lengths) {
+        for (unsigned length2 : lengths) {
+            std::vector<uint32_t> symbols1(length1), symbols2(length2);
+            for (uint32_t &symbol : symbols1) { symbol = next() % 8; }
+            for (uint32_t &symbol : symbols2) { symbol = next() % 8; }
+
+            Genome genome1(length1), genome2(length2);
+            std::memcpy(genome1.data(), symbols1.data(), length1 * sizeof(Gene));
+            std::memcpy(genome2.data(), symbols2.data(), length2 * sizeof(Gene));
+
+            const float expected = (length1 + length2 == 0) ? 1.0f
+                : 2.0f * referenceLcs(symbols1, symbols2) / (float)(length1 + length2);
+            const float similarity = lcsSimilarity(genome1, genome2);
+            if (similarity != expected) {
+                std::cout << "LCS similarity of lengths " << length1 << ", " << length2 << " is "
+                          << similarity << ", expected " << expected << std::endl;
+            }
+            assert(similarity == expected);
+            assert(lcsSimilarity(genome2, genome1) == similarity);
+            assert(lcsSimilarity(genome1, genome1) == 1.0f);
+        }
+    }
+
+    return true;
+}
+
+} // end namespace BS
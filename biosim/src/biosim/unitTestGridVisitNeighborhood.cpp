@@ -7,6 +7,7 @@ namespace BS {
 
 void unitTestGridVisitNeighborhood()
 {
+    const Params &p = *world->params;
     // prints each coord:
     auto printLoc = [&](Coord loc){ std::cout << loc.x << ", " << loc.y << std::endl; };
 